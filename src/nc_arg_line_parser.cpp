@@ -0,0 +1,219 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_arg_line_parser.h"
+
+ArgLineParser::ArgLineParser(ArgParser* parser, const char* programName, ArgAllocator* allocator)
+	: _memory(allocator)
+{
+	_parser = parser;
+	_programName = programName;
+	_capacity = 0;
+	_line = NULL;
+	_text = NULL;
+	_lineLength = 0;
+	_argCapacity = 0;
+	_argc = 0;
+	_argv = NULL;
+	_wordEnds = NULL;
+	_incomplete = false;
+}
+
+ArgLineParser::~ArgLineParser()
+{
+	_memory.deallocate(_line, _capacity * 2);
+	_memory.deallocate(_argv, _argCapacity * (sizeof(char*) + sizeof(size_t)));
+}
+
+bool ArgLineParser::_reserveLine(size_t lineLength, size_t keptLength)
+{
+	if (lineLength + 1 <= _capacity)
+		return true;
+
+	size_t capacity = _capacity != 0 ? _capacity * 2 : 256;
+	while (capacity < lineLength + 1)
+		capacity *= 2;
+
+	// one block: the line, then the text
+	char* block = (char*)_memory.allocate(capacity * 2);
+	if (block == NULL)
+		return false;
+	if (keptLength != 0)
+		memcpy(block, _line, keptLength);
+
+	_memory.deallocate(_line, _capacity * 2);
+	_capacity = capacity;
+	_line = block;
+	_text = block + capacity;
+	return true;
+}
+
+bool ArgLineParser::_reserveArgs(int argc)
+{
+	if (argc <= _argCapacity)
+		return true;
+
+	int capacity = _argCapacity != 0 ? _argCapacity * 2 : 16;
+	while (capacity < argc)
+		capacity *= 2;
+
+	char* block = (char*)_memory.allocate(capacity * (sizeof(char*) + sizeof(size_t)));
+	if (block == NULL)
+		return false;
+	char** argv = (char**)block;
+	size_t* wordEnds = (size_t*)(block + capacity * sizeof(char*));
+	if (_argc != 0)
+	{
+		memcpy(argv, _argv, sizeof(char*) * _argc);
+		memcpy(wordEnds, _wordEnds, sizeof(size_t) * _argc);
+	}
+
+	_memory.deallocate(_argv, _argCapacity * (sizeof(char*) + sizeof(size_t)));
+	_argCapacity = capacity;
+	_argv = argv;
+	_wordEnds = wordEnds;
+	return true;
+}
+
+// NUL too: unquoting in place can overwrite the blank after a word with the terminator
+static forceinline bool _isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\0';
+}
+
+char* ArgLineParser::nextWord(const char* line, size_t lineLength, size_t* position, char* text, bool* incomplete)
+{
+	size_t p = *position;
+	while (p < lineLength && _isBlank(line[p]))
+		p++;
+	if (p == lineLength)
+	{
+		*position = p;
+		return NULL;
+	}
+
+	char* word = text + p;
+	char* w = word;
+	char quote = '\0';
+	while (p < lineLength)
+	{
+		char c = line[p];
+		if (quote == '\'')
+		{
+			if (c == '\'')
+				quote = '\0';
+			else
+				*w++ = c;
+			p++;
+		}
+		else if (quote == '"')
+		{
+			if (c == '"')
+				quote = '\0';
+			else if (c == '\\' && p + 1 < lineLength && !_isBlank(line[p + 1]) && strchr("\\\"$`", line[p + 1]) != NULL)
+				*w++ = line[++p];
+			else
+				*w++ = c;
+			p++;
+		}
+		else if (_isBlank(c))
+			break;
+		else if (c == '\'' || c == '"')
+		{
+			quote = c;
+			p++;
+		}
+		else if (c == '\\')
+		{
+			if (p + 1 < lineLength)
+				*w++ = line[++p];
+			else
+				*incomplete = true;
+			p++;
+		}
+		else
+		{
+			*w++ = c;
+			p++;
+		}
+	}
+	*w = '\0';
+	if (quote != '\0')
+		*incomplete = true;
+
+	*position = p;
+	return word;
+}
+
+bool ArgLineParser::parse(const char* line)
+{
+	return parse(line, strlen(line));
+}
+
+bool ArgLineParser::parse(const char* line, size_t lineLength)
+{
+	// Only valid while nobody else has parsed with the parser, and the text doesn't move.
+	bool incremental = _argc != 0 && _parser->argv() == _argv && lineLength + 1 <= _capacity;
+
+	// a word is kept if the blank after it is in front of the first edited character
+	size_t same = 0;
+	while (same < _lineLength && same < lineLength && _line[same] == line[same])
+		same++;
+	int keptArgc = 1;
+	while (incremental && keptArgc < _argc && _wordEnds[keptArgc] < same)
+		keptArgc++;
+
+	if (!_reserveLine(lineLength, same) || !_reserveArgs(2))
+	{
+		_argc = 0;
+		_parser->diagnosticSink()->report(ArgError_outOfMemory, NULL, "Out of memory");
+		return false;
+	}
+	memcpy(_line + same, line + same, lineLength - same);
+	_lineLength = lineLength;
+
+	_argc = keptArgc;
+	_argv[0] = (char*)_programName;
+	_incomplete = false;
+
+	size_t p = keptArgc > 1 ? _wordEnds[keptArgc - 1] : 0;
+	char* word;
+	while ((word = nextWord(line, lineLength, &p, _text, &_incomplete)) != NULL)
+	{
+		if (!_reserveArgs(_argc + 2))
+		{
+			_argc = 0;
+			_parser->diagnosticSink()->report(ArgError_outOfMemory, NULL, "Out of memory");
+			return false;
+		}
+		_argv[_argc] = word;
+		_wordEnds[_argc++] = p;
+	}
+	_argv[_argc] = NULL;
+
+	if (incremental)
+		_parser->reparse(_argc, _argv, keptArgc);
+	else
+		_parser->parse(_argc, _argv);
+	return true;
+}
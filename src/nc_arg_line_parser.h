@@ -0,0 +1,95 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_argparse.h"
+
+/*
+Parses the lines typed into an interactive shell, e.g. on every keystroke for hints:
+
+	ArgParser parser;
+	parser.bindAliaseName("i", "interactive");
+	ArgLineParser lineParser(&parser, "compile");
+
+	lineParser.parse("-i 'my file.c' -o out");
+	if (parser.hasArg("i", "interactive"))
+		...
+
+The words are split on blanks with the quoting of a POSIX shell: 'single quotes' are literal,
+in "double quotes" a backslash only escapes \ " $ and `, outside of quotes it escapes any character.
+
+The schema and the arena of the parser are reused. The words in front of the first edited
+character, and the arguments taken from them, are kept from the previous line, so typing
+at the end of a line only tokenizes and parses the last word again.
+*/
+class ArgLineParser
+{
+public:
+	// argv[0] is programName. allocator NULL means ArgAllocator::defaultAllocator()
+	ArgLineParser(ArgParser* parser, const char* programName = "", ArgAllocator* allocator = NULL);
+	~ArgLineParser();
+
+	// Returns false if out of memory, which is reported to the sink of the parser.
+	bool parse(const char* line);
+	bool parse(const char* line, size_t lineLength);
+
+	// The line ends inside quotes or with a backslash, i.e. the command isn't finished yet.
+	forceinline bool incomplete() { return _incomplete; }
+
+	forceinline int argc() { return _argc; }
+	forceinline char** argv() { return _argv; }
+	forceinline ArgParser* parser() { return _parser; }
+
+	/*
+		Splits the next word from line[*position], skipping the blanks in front of it.
+		The unquoted word is written at the same offset of text, which can be the line itself.
+		Returns NULL at the end of the line. *incomplete is set for an unfinished quote or escape.
+	*/
+	static char* nextWord(const char* line, size_t lineLength, size_t* position, char* text, bool* incomplete);
+
+private:
+	ArgParser* _parser;
+	const char* _programName;
+	ArgMemory _memory;
+
+	// _line keeps the previous line. The text of a word starts at the offset of the word in the line,
+	// unquoting only makes it shorter, so the words in front of an edit keep their addresses.
+	size_t _capacity;
+	char* _line;
+	char* _text;
+	size_t _lineLength;
+
+	int _argCapacity;
+	int _argc;
+	char** _argv;
+	size_t* _wordEnds;	// offset after the word in the line
+
+	bool _incomplete;
+
+	bool _reserveLine(size_t lineLength, size_t keptLength);
+	bool _reserveArgs(int argc);
+
+	ArgLineParser(const ArgLineParser&);
+	ArgLineParser& operator=(const ArgLineParser&);
+};
@@ -0,0 +1,218 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_arg_validator.h"
+
+ArgValidator::ArgValidator()
+{
+	_optionNumber = 0;
+	_required = 0;
+	_withChoices = 0;
+	_withRange = 0;
+	_withDependencies = 0;
+	_exclusiveGroupNumber = 0;
+	_minPositionalNumber = 0;
+	_maxPositionalNumber = (size_t)-1;
+	_given = 0;
+}
+
+int ArgValidator::addOption(const char* name, const char* aliaseName)
+{
+	if (_optionNumber == sizeof(_options) / sizeof(_options[0]))
+		return -1;
+
+	Option& o = _options[_optionNumber];
+	o.name = name;
+	o.aliaseName = aliaseName;
+	o.choices = NULL;
+	o.minValue = 0;
+	o.maxValue = 0;
+	_dependencies[_optionNumber] = 0;
+	return (int)_optionNumber++;
+}
+
+void ArgValidator::require(int option)
+{
+	_required |= maskOf(option);
+}
+
+void ArgValidator::setChoices(int option, const char* commaSplittedChoices)
+{
+	if (option < 0)
+		return;
+	_options[option].choices = commaSplittedChoices;
+	_withChoices |= maskOf(option);
+}
+
+void ArgValidator::setRange(int option, double minValue, double maxValue)
+{
+	if (option < 0)
+		return;
+	_options[option].minValue = minValue;
+	_options[option].maxValue = maxValue;
+	_withRange |= maskOf(option);
+}
+
+void ArgValidator::addExclusiveGroup(uint64_t options)
+{
+	if (_exclusiveGroupNumber < sizeof(_exclusiveGroups) / sizeof(_exclusiveGroups[0]))
+		_exclusiveGroups[_exclusiveGroupNumber++] = options;
+}
+
+void ArgValidator::addDependency(int option, int requiredOption)
+{
+	if (option < 0)
+		return;
+	_dependencies[option] |= maskOf(requiredOption);
+	_withDependencies |= maskOf(option);
+}
+
+void ArgValidator::setPositionalArgNumber(size_t minNumber, size_t maxNumber)
+{
+	_minPositionalNumber = minNumber;
+	_maxPositionalNumber = maxNumber;
+}
+
+static bool _isChoice(const char* commaSplittedChoices, const char* value)
+{
+	size_t valueLength = strlen(value);
+	const char* p = commaSplittedChoices;
+	while (*p != '\0')
+	{
+		while (*p == ',' || *p == ' ')
+			p++;
+		const char* choice = p;
+		while (*p != '\0' && *p != ',' && *p != ' ')
+			p++;
+		if ((size_t)(p - choice) == valueLength && memcmp(choice, value, valueLength) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool _isInRange(const char* value, double minValue, double maxValue)
+{
+	char* end;
+	double v = strtod(value, &end);
+	return end != value && *end == '\0' && v >= minValue && v <= maxValue;
+}
+
+static forceinline bool _isGiven(ArgSource source)
+{
+	return source == ArgSource_argv || source == ArgSource_alias;
+}
+
+// getArgSource() only sees one scope, an option before the subcommand is in a parent
+static bool _isGiven(ArgParser& parser, const char* name)
+{
+	for (ArgParser* scope = &parser; scope != NULL; scope = scope->parent())
+	{
+		if (_isGiven(scope->getArgSource(name)))
+			return true;
+	}
+	return false;
+}
+
+// index of the lowest bit
+static forceinline int _lowestBit(uint64_t mask)
+{
+	int i = 0;
+	while ((mask & 1) == 0)
+	{
+		mask >>= 1;
+		i++;
+	}
+	return i;
+}
+
+bool ArgValidator::validate(ArgParser& parser)
+{
+	DiagnosticSink* sink = parser.diagnosticSink();
+	bool ok = true;
+
+	_given = 0;
+	for (size_t i = 0; i < _optionNumber; i++)
+	{
+		const Option& o = _options[i];
+		if (_isGiven(parser, o.name) || (o.aliaseName != NULL && _isGiven(parser, o.aliaseName)))
+			_given |= (uint64_t)1 << i;
+	}
+
+	for (uint64_t missing = _required & ~_given; missing != 0; missing &= missing - 1)
+	{
+		sink->report(ArgError_missingArgument, _options[_lowestBit(missing)].name, "Missing required argument");
+		ok = false;
+	}
+
+	for (size_t i = 0; i < _exclusiveGroupNumber; i++)
+	{
+		uint64_t conflicts = _exclusiveGroups[i] & _given;
+		if ((conflicts & (conflicts - 1)) != 0)	// more than one bit
+		{
+			sink->report(ArgError_conflictingArguments, _options[_lowestBit(conflicts)].name, "Conflicting arguments");
+			ok = false;
+		}
+	}
+
+	for (uint64_t dependent = _withDependencies & _given; dependent != 0; dependent &= dependent - 1)
+	{
+		int i = _lowestBit(dependent);
+		uint64_t missing = _dependencies[i] & ~_given;
+		if (missing != 0)
+		{
+			sink->report(ArgError_missingDependency, _options[i].name, "Requires another argument");
+			ok = false;
+		}
+	}
+
+	// every declared option is known, whether it was given or not
+	for (size_t i = 0; i < _optionNumber; i++)
+	{
+		const Option& o = _options[i];
+		uint64_t bit = (uint64_t)1 << i;
+		const char* value = o.aliaseName != NULL ? parser.getArg(o.name, o.aliaseName) : parser.getArg(o.name);
+		if (value == NULL)
+			continue;
+
+		if (((_withChoices & bit) != 0 && !_isChoice(o.choices, value))
+			|| ((_withRange & bit) != 0 && !_isInRange(value, o.minValue, o.maxValue)))
+		{
+			sink->report(ArgError_invalidValue, o.name, "Invalid value");
+			ok = false;
+		}
+	}
+
+	size_t positionalNumber = parser.getPositionalArgNumber();
+	if (positionalNumber < _minPositionalNumber)
+	{
+		sink->report(ArgError_missingArgument, NULL, "Too few arguments");
+		ok = false;
+	}
+	else if (positionalNumber > _maxPositionalNumber)
+	{
+		sink->report(ArgError_syntaxError, NULL, "Too many arguments");
+		ok = false;
+	}
+
+	return ok;
+}
@@ -0,0 +1,101 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_argparse.h"
+
+/*
+Declarative checks of the arguments of one subcommand.
+
+Every option gets an id (up to 64), and the constraints are kept as bit masks over
+those ids, so checking an invocation is a few AND/OR operations on the mask of the
+options that were given:
+
+	ArgValidator validator;
+	int mode = validator.addOption("mode");
+	int output = validator.addOption("o", "output");
+	int stdoutId = validator.addOption("stdout");
+	validator.setChoices(mode, "fast,slow");
+	validator.addExclusiveGroup(validator.maskOf(output) | validator.maskOf(stdoutId));
+	validator.setPositionalArgNumber(1, 1);
+
+	if (!validator.validate(parser))
+		return false;
+
+Errors are reported to the diagnostic sink of the parser.
+*/
+class ArgValidator
+{
+public:
+	ArgValidator();
+
+	// Returns the id of the option, or -1 if there are already 64 options.
+	int addOption(const char* name, const char* aliaseName = NULL);
+	forceinline uint64_t maskOf(int option) { return option >= 0 ? (uint64_t)1 << option : 0; }
+
+	void require(int option);
+	void setChoices(int option, const char* commaSplittedChoices);
+	void setRange(int option, double minValue, double maxValue);
+	// At most one option of the group can be given.
+	void addExclusiveGroup(uint64_t options);
+	// "option" can only be given together with "requiredOption".
+	void addDependency(int option, int requiredOption);
+	void setPositionalArgNumber(size_t minNumber, size_t maxNumber);
+
+	/*
+		Checks the arguments and marks the declared options as used.
+		An option counts as given only when it's on the command line, defaults don't count.
+		In a scope, the options given to its parents count too, see ArgParser::parseScope().
+	*/
+	bool validate(ArgParser& parser);
+	// The options given to the last validate().
+	forceinline uint64_t givenOptions() { return _given; }
+
+private:
+	struct Option
+	{
+		const char* name;
+		const char* aliaseName;
+		const char* choices;
+		double minValue;
+		double maxValue;
+	};
+
+	size_t _optionNumber;
+	Option _options[64];
+
+	uint64_t _required;
+	uint64_t _withChoices;
+	uint64_t _withRange;
+	uint64_t _withDependencies;
+	uint64_t _dependencies[64];
+
+	size_t _exclusiveGroupNumber;
+	uint64_t _exclusiveGroups[16];
+
+	size_t _minPositionalNumber;
+	size_t _maxPositionalNumber;
+
+	uint64_t _given;
+};
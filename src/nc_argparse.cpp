@@ -23,129 +23,1310 @@ SOFTWARE.
 */
 #include "nc_argparse.h"
 
-ArgParser::ArgParser()
+// In header-only mode this file is included by nc_argparse.h.
+#ifndef NC_ARGPARSE_IMPLEMENTATION
+#define NC_ARGPARSE_IMPLEMENTATION
+
+#include "nc_text_writer.h"
+
+static forceinline bool _equals(const char* a, size_t aLength, const char* b, size_t bLength)
+{
+	return aLength == bLength && memcmp(a, b, aLength) == 0;
+}
+
+static forceinline uint32_t _hash(const char* key, size_t keyLength)
+{
+	uint32_t h = 2166136261u;	// FNV-1a
+	for (size_t i = 0; i < keyLength; i++)
+		h = (h ^ (unsigned char)key[i]) * 16777619u;
+	return h;
+}
+
+static const char* _errorCodeName(ArgError code)
+{
+	switch (code)
+	{
+	case ArgError_none: return "none";
+	case ArgError_unknownArgument: return "unknownArgument";
+	case ArgError_noSubcommand: return "noSubcommand";
+	case ArgError_unknownSubcommand: return "unknownSubcommand";
+	case ArgError_syntaxError: return "syntaxError";
+	case ArgError_ambiguousArgument: return "ambiguousArgument";
+	case ArgError_outOfMemory: return "outOfMemory";
+	case ArgError_missingArgument: return "missingArgument";
+	case ArgError_invalidValue: return "invalidValue";
+	case ArgError_conflictingArguments: return "conflictingArguments";
+	case ArgError_missingDependency: return "missingDependency";
+	case ArgError_invalidEncoding: return "invalidEncoding";
+	}
+	return "unknown";
+}
+
+NC_ARGPARSE_INLINE void StdioDiagnosticSink::report(ArgError, const char* key, const char* message)
+{
+	if (key != NULL)
+		printf("error: %s: %s\n", message, key);
+	else
+		printf("error: %s\n", message);
+}
+
+NC_ARGPARSE_INLINE StdioDiagnosticSink* StdioDiagnosticSink::instance()
+{
+	static StdioDiagnosticSink sink;
+	return &sink;
+}
+
+NC_ARGPARSE_INLINE BufferedDiagnosticSink::BufferedDiagnosticSink()
+{
+	_diagnosticNumber = 0;
+	_droppedNumber = 0;
+	_textLength = 0;
+}
+
+NC_ARGPARSE_INLINE void BufferedDiagnosticSink::report(ArgError code, const char* key, const char* message)
+{
+	// the key may point into argv or the arena of a parser that is reused before the formatting
+	size_t keySize = key != NULL ? strlen(key) + 1 : 0;
+	size_t messageSize = strlen(message) + 1;
+	if (_diagnosticNumber == sizeof(_diagnostics) / sizeof(_diagnostics[0])
+		|| keySize + messageSize > sizeof(_text) - _textLength)
+	{
+		_droppedNumber++;
+		return;
+	}
+
+	ArgDiagnostic& d = _diagnostics[_diagnosticNumber++];
+	d.code = code;
+	d.key = NULL;
+	if (key != NULL)
+	{
+		d.key = (const char*)memcpy(_text + _textLength, key, keySize);
+		_textLength += keySize;
+	}
+	d.message = (const char*)memcpy(_text + _textLength, message, messageSize);
+	_textLength += messageSize;
+}
+
+NC_ARGPARSE_INLINE void BufferedDiagnosticSink::clear()
+{
+	_diagnosticNumber = 0;
+	_droppedNumber = 0;
+	_textLength = 0;
+}
+
+NC_ARGPARSE_INLINE size_t BufferedDiagnosticSink::formatText(char* buffer, size_t bufferSize)
+{
+	ArgTextWriter w(buffer, bufferSize);
+	for (size_t i = 0; i < _diagnosticNumber; i++)
+	{
+		const ArgDiagnostic& d = _diagnostics[i];
+		w.append("error: ");
+		w.append(d.message);
+		if (d.key != NULL)
+		{
+			w.append(": ");
+			w.append(d.key);
+		}
+		w.append("\n", 1);
+	}
+	return w.length;
+}
+
+NC_ARGPARSE_INLINE size_t BufferedDiagnosticSink::formatJson(char* buffer, size_t bufferSize)
+{
+	ArgTextWriter w(buffer, bufferSize);
+	w.append("[");
+	for (size_t i = 0; i < _diagnosticNumber; i++)
+	{
+		const ArgDiagnostic& d = _diagnostics[i];
+		if (i != 0)
+			w.append(",");
+		w.append("{\"code\":\"");
+		w.append(_errorCodeName(d.code));
+		w.append("\",\"key\":");
+		if (d.key != NULL)
+			w.appendJsonString(d.key);
+		else
+			w.append("null");
+		w.append(",\"message\":");
+		w.appendJsonString(d.message);
+		w.append("}");
+	}
+	w.append("]");
+	return w.length;
+}
+
+class MallocAllocator : public ArgAllocator
+{
+public:
+	virtual void* allocate(size_t size) override { return malloc(size); }
+	virtual void deallocate(void* p, size_t) override { free(p); }
+};
+
+NC_ARGPARSE_INLINE ArgAllocator* ArgAllocator::defaultAllocator()
+{
+	static MallocAllocator allocator;
+	return &allocator;
+}
+
+NC_ARGPARSE_INLINE ArgMemory::ArgMemory(ArgAllocator* allocator)
+{
+	memset(&stats, 0, sizeof(stats));
+	_allocator = allocator != NULL ? allocator : ArgAllocator::defaultAllocator();
+}
+
+NC_ARGPARSE_INLINE void* ArgMemory::allocate(size_t size)
+{
+	NC_ARGPARSE_COUNT(stats.allocations++);
+	NC_ARGPARSE_COUNT(stats.allocatedBytes += size);
+	return _allocator->allocate(size);
+}
+
+NC_ARGPARSE_INLINE void ArgMemory::deallocate(void* p, size_t size)
+{
+	if (p != NULL)
+		_allocator->deallocate(p, size);
+}
+
+NC_ARGPARSE_INLINE ArgArena::ArgArena(ArgMemory* memory)
+{
+	_memory = memory;
+	_blocks = NULL;
+}
+
+NC_ARGPARSE_INLINE ArgArena::~ArgArena()
+{
+	_freeBlocks();
+}
+
+NC_ARGPARSE_INLINE void ArgArena::_freeBlocks()
+{
+	while (_blocks != NULL)
+	{
+		Block* next = _blocks->next;
+		_memory->deallocate(_blocks, sizeof(Block) + _blocks->size);
+		_blocks = next;
+	}
+}
+
+NC_ARGPARSE_INLINE bool ArgArena::_addBlock(size_t blockSize)
+{
+	Block* block = (Block*)_memory->allocate(sizeof(Block) + blockSize);
+	if (block == NULL)
+		return false;
+	block->next = _blocks;
+	block->size = blockSize;
+	block->used = 0;
+	_blocks = block;
+	return true;
+}
+
+NC_ARGPARSE_INLINE void* ArgArena::allocate(size_t size)
+{
+	const size_t alignment = sizeof(void*);
+	size = (size + alignment - 1) & ~(alignment - 1);
+
+	if (_blocks == NULL || _blocks->size - _blocks->used < size)
+	{
+		if (!_addBlock(size > 4096 ? size : 4096))
+			return NULL;
+	}
+
+	void* p = (char*)(_blocks + 1) + _blocks->used;
+	_blocks->used += size;
+	return p;
+}
+
+NC_ARGPARSE_INLINE void ArgArena::clear()
+{
+	if (_blocks == NULL)
+		return;
+
+	if (_blocks->next != NULL)
+	{
+		// one block as big as all of them, so the next parse of the same size needs no other
+		size_t blockSize = 0;
+		for (Block* block = _blocks; block != NULL; block = block->next)
+			blockSize += block->size;
+		_freeBlocks();
+		_addBlock(blockSize);
+		return;
+	}
+	_blocks->used = 0;
+}
+
+NC_ARGPARSE_INLINE ArgStringPool::ArgStringPool(ArgAllocator* allocator)
+	: _memory(allocator), _texts(&_memory)
+{
+	_number = 0;
+	_capacity = 0;
+	_strings = NULL;
+	_lengths = NULL;
+	_hashes = NULL;
+	_slotNumber = 0;
+	_slots = NULL;
+}
+
+NC_ARGPARSE_INLINE ArgStringPool::~ArgStringPool()
+{
+	_memory.deallocate(_strings, _capacity * (sizeof(const char*) + sizeof(uint32_t) * 2));
+	_memory.deallocate(_slots, _slotNumber * sizeof(ArgStringId));
+}
+
+NC_ARGPARSE_INLINE ArgStringId* ArgStringPool::_findSlot(const char* text, size_t length, uint32_t hash)
+{
+	// the slot of the text, or the empty one where it goes
+	size_t mask = _slotNumber - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask)
+	{
+		ArgStringId id = _slots[i];
+		if (id == 0 || (_hashes[id - 1] == hash && _equals(_strings[id - 1], _lengths[id - 1], text, length)))
+			return &_slots[i];
+	}
+}
+
+NC_ARGPARSE_INLINE bool ArgStringPool::_grow()
+{
+	// the columns, one block like the columns of the parser
+	size_t capacity = _capacity != 0 ? _capacity * 2 : 64;
+	char* block = (char*)_memory.allocate(capacity * (sizeof(const char*) + sizeof(uint32_t) * 2));
+	size_t slotNumber = capacity * 2;
+	ArgStringId* slots = (ArgStringId*)_memory.allocate(slotNumber * sizeof(ArgStringId));
+	if (block == NULL || slots == NULL)
+	{
+		_memory.deallocate(block, capacity * (sizeof(const char*) + sizeof(uint32_t) * 2));
+		_memory.deallocate(slots, slotNumber * sizeof(ArgStringId));
+		return false;
+	}
+
+	const char** strings = (const char**)block;
+	uint32_t* lengths = (uint32_t*)(strings + capacity);
+	uint32_t* hashes = lengths + capacity;
+	if (_number != 0)
+	{
+		memcpy(strings, _strings, sizeof(const char*) * _number);
+		memcpy(lengths, _lengths, sizeof(uint32_t) * _number);
+		memcpy(hashes, _hashes, sizeof(uint32_t) * _number);
+	}
+	_memory.deallocate(_strings, _capacity * (sizeof(const char*) + sizeof(uint32_t) * 2));
+	_memory.deallocate(_slots, _slotNumber * sizeof(ArgStringId));
+	_strings = strings;
+	_lengths = lengths;
+	_hashes = hashes;
+	_capacity = capacity;
+
+	// rehash from the stored hashes
+	memset(slots, 0, slotNumber * sizeof(ArgStringId));
+	_slots = slots;
+	_slotNumber = slotNumber;
+	for (size_t id = 1; id <= _number; id++)
+	{
+		size_t i = _hashes[id - 1] & (slotNumber - 1);
+		while (_slots[i] != 0)
+			i = (i + 1) & (slotNumber - 1);
+		_slots[i] = (ArgStringId)id;
+	}
+	return true;
+}
+
+NC_ARGPARSE_INLINE ArgStringId ArgStringPool::intern(const char* text, size_t length)
+{
+	if (length > UINT32_MAX)
+		return 0;
+	uint32_t hash = _hash(text, length);
+	if (_slotNumber != 0)
+	{
+		ArgStringId id = *_findSlot(text, length, hash);
+		if (id != 0)
+			return id;
+	}
+	if (_number == _capacity && !_grow())
+		return 0;
+
+	char* copy = (char*)_texts.allocate(length + 1);
+	if (copy == NULL)
+		return 0;
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	_strings[_number] = copy;
+	_lengths[_number] = (uint32_t)length;
+	_hashes[_number] = hash;
+	ArgStringId id = (ArgStringId)++_number;
+	*_findSlot(text, length, hash) = id;
+	return id;
+}
+
+NC_ARGPARSE_INLINE ArgStringId ArgStringPool::find(const char* text, size_t length)
+{
+	return _slotNumber != 0 ? *_findSlot(text, length, _hash(text, length)) : 0;
+}
+
+NC_ARGPARSE_INLINE ArgParser::ArgParser(ArgAllocator* allocator)
+	: _memory(allocator), _schemaArena(&_memory), _arena(&_memory)
+{
+	memset(&_valueNumberColumns, 0, sizeof(Columns));
+	memset(&_defaultColumns, 0, sizeof(Columns));
+	memset(&_shortNameColumns, 0, sizeof(Columns));
+	memset(&_optionNameColumns, 0, sizeof(Columns));
+	memset(&_sortedNameColumns, 0, sizeof(Columns));
+	memset(&_choiceOptionColumns, 0, sizeof(Columns));
+	memset(&_keyColumns, 0, sizeof(Columns));
+	memset(&_freeOptionColumns, 0, sizeof(Columns));
+
+	_sink = StdioDiagnosticSink::instance();
+	_valueNumberNumber = 0;
+	_defaultNumber = 0;
+	_shortNameNumber = 0;
+	_prefixMatching = false;
+	_lazyParsing = false;
+	_caseInsensitive = false;
+	_caseInsensitiveKeys = false;
+	_validateUtf8 = false;
+	_pool = NULL;
+	_scopeCommands = NULL;
+	_optionNameNumber = 0;
+	_sortedNameNumber = 0;
+	_choiceOptionNumber = 0;
+	_tokenizer = NULL;
+	_syntaxCaseInsensitive = false;
+
+	_generation = 0;
+	_cacheGeneration = 0;
+	_parentCacheGeneration = 0;
+	memset(_lookupCache, 0, sizeof(_lookupCache));
+	reset();
+}
+
+NC_ARGPARSE_INLINE ArgParser::~ArgParser()
+{
+	_release(_valueNumberColumns);
+	_release(_defaultColumns);
+	_release(_shortNameColumns);
+	_release(_optionNameColumns);
+	_release(_sortedNameColumns);
+	_release(_choiceOptionColumns);
+	_release(_keyColumns);
+	_release(_freeOptionColumns);
+}
+
+template <typename... T>
+NC_ARGPARSE_INLINE bool ArgParser::_reserve(Columns& columns, size_t number, size_t neededNumber, T*&... arrays)
+{
+	if (neededNumber <= columns.capacity)
+		return true;
+
+	// the capacity stays a multiple of 16, so every array keeps its alignment
+	size_t capacity = columns.capacity != 0 ? columns.capacity * 2 : 16;
+	while (capacity < neededNumber)
+		capacity *= 2;
+
+	size_t blockSize = capacity * (sizeof(T) + ...);
+	char* block = (char*)_memory.allocate(blockSize);
+	if (block == NULL)
+	{
+		_reportOutOfMemory();
+		return false;
+	}
+
+	char* p = block;
+	((number != 0 ? memcpy(p, arrays, sizeof(T) * number) : p, arrays = (T*)p, p += sizeof(T) * capacity), ...);
+
+	_memory.deallocate(columns.block, columns.blockSize);
+	columns.block = block;
+	columns.blockSize = blockSize;
+	columns.capacity = capacity;
+	return true;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_release(Columns& columns)
+{
+	_memory.deallocate(columns.block, columns.blockSize);
+	memset(&columns, 0, sizeof(Columns));
+}
+
+NC_ARGPARSE_INLINE bool ArgParser::_reserveKeys()
+{
+	return _reserve(_keyColumns, _keyValueNumber, _keyValueNumber + 1, _keys, _foldedKeys, _values, _moreValues, _wideValues, _keyLengths, _keyValueCount, _keyUsedStamps, _valueIds, _keyArgIndex, _keyAmbiguous);
+}
+
+NC_ARGPARSE_INLINE bool ArgParser::_reserveFreeOptions()
+{
+	return _reserve(_freeOptionColumns, _freeOptionNumber, _freeOptionNumber + 1, _freeOptions, _wideFreeOptions);
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_reportOutOfMemory()
+{
+	if (!_outOfMemoryReported)
+		_sink->report(ArgError_outOfMemory, NULL, "Out of memory");
+	_outOfMemoryReported = true;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::reset()
+{
+	m_argc = 0;
+	m_argv = NULL;
+	_nextArgIndex = 0;
+
+	// the stamps of the previous invocation become stale instead of being cleared.
+	// Stamps are written when an argument is added, 0 is never a valid generation.
+	if (++_generation == 0)
+		_generation = 1;
+	_keyValueNumber = 0;
+	_freeOptionNumber = 0;
+	_unknownArgIter = 0;
+	_subcommandParsed = false;
+	_subcommand = NULL;
+	_subcommandArgc = 0;
+	_parent = NULL;
+	_prefixIndexDirty = _prefixMatching;
+	_arena.clear();
+	_outOfMemoryReported = false;
+	_argPool = NULL;
+	_invalidateCache();
+}
+
+NC_ARGPARSE_INLINE void ArgParser::bindAliaseName(const char* name1, const char* name2)
+{
+	// a pooled parser binds the same names for every invocation
+	char buffer1[64], buffer2[64];
+	size_t length1 = strlen(name1), length2 = strlen(name2);
+	const char* folded1 = _foldQuery(name1, length1, buffer1);
+	const char* folded2 = _foldQuery(name2, length2, buffer2);
+	for (size_t i = 0; i < _shortNameNumber; i++)
+	{
+		if (strcmp(_shortNames[i], folded1) == 0 && strcmp(_shortNameValues[i], folded2) == 0)
+			return;
+	}
+
+	if (!_reserve(_shortNameColumns, _shortNameNumber, _shortNameNumber + 1, _shortNames, _shortNameValues, _otherShortNames, _otherShortNameValues, _shortNameLengths, _shortNameValueLengths))
+		return;
+
+	_setSchemaName(_shortNames[_shortNameNumber], _otherShortNames[_shortNameNumber], name1, length1);
+	_shortNameLengths[_shortNameNumber] = length1;
+	_setSchemaName(_shortNameValues[_shortNameNumber], _otherShortNameValues[_shortNameNumber], name2, length2);
+	_shortNameValueLengths[_shortNameNumber] = length2;
+	_shortNameNumber++;
+	_prefixIndexDirty = _prefixMatching;
+	_invalidateCache();
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::getAliaseName(const char* key)
+{
+	size_t aliaseLength = 0;
+	return _getAliaseName(key, strlen(key), &aliaseLength);
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::_getAliaseName(const char* key, size_t keyLength, size_t* aliaseLength)
+{
+	char buffer[64];
+	key = _foldQuery(key, keyLength, buffer);
+	for (size_t i = 0; i < _shortNameNumber; i++)
+	{
+		if (_equals(key, keyLength, _shortNames[i], _shortNameLengths[i]))
+		{
+			*aliaseLength = _shortNameValueLengths[i];
+			return _shortNameValues[i];
+		}
+		else if (_equals(key, keyLength, _shortNameValues[i], _shortNameValueLengths[i]))
+		{
+			*aliaseLength = _shortNameLengths[i];
+			return _shortNames[i];
+		}
+	}
+
+	return NULL;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setDefault(const char* key, const char* v)
+{
+	size_t keyLength = strlen(key);
+	char buffer[64];
+	const char* foldedKey = _foldQuery(key, keyLength, buffer);
+	for (size_t i = 0; i < _defaultNumber; i++)
+	{
+		if (_equals(foldedKey, keyLength, _defaultKeys[i], _defaultKeyLengths[i]))
+		{
+			_defaultValues[i] = v;
+			_defaultWideStamps[i] = 0;
+			_invalidateCache();
+			return;
+		}
+	}
+
+	if (!_reserve(_defaultColumns, _defaultNumber, _defaultNumber + 1, _defaultKeys, _otherDefaultKeys, _defaultValues, _defaultWideValues, _defaultKeyLengths, _defaultWideStamps))
+		return;
+
+	_setSchemaName(_defaultKeys[_defaultNumber], _otherDefaultKeys[_defaultNumber], key, keyLength);
+	_defaultKeyLengths[_defaultNumber] = keyLength;
+	_defaultValues[_defaultNumber] = v;
+	_defaultWideStamps[_defaultNumber] = 0;
+	_defaultNumber++;
+	_prefixIndexDirty = _prefixMatching;
+	_invalidateCache();
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::getDefault(const char* key)
+{
+	return _getDefault(key, strlen(key));
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::_getDefault(const char* key, size_t keyLength)
+{
+	char buffer[64];
+	key = _foldQuery(key, keyLength, buffer);
+	for (size_t i = 0; i < _defaultNumber; i++)
+	{
+		if (_equals(key, keyLength, _defaultKeys[i], _defaultKeyLengths[i]))
+		{
+			return _defaultValues[i];
+		}
+	}
+
+	return NULL;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setPrefixMatching(bool enabled)
+{
+	_prefixMatching = enabled;
+	_prefixIndexDirty = enabled;
+	_invalidateCache();
+}
+
+static bool _isSubcommand(const char* commaSplittedCommands, const char* subcommand, size_t subcommandLength)
+{
+	const char* p = commaSplittedCommands;
+	while (*p != '\0')
+	{
+		while (*p == ',' || *p == ' ')
+			p++;
+		const char* command = p;
+		while (*p != '\0' && *p != ',' && *p != ' ')
+			p++;
+		if (p != command && _equals(command, p - command, subcommand, subcommandLength))
+			return true;
+	}
+	return false;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setScopeCommands(const char* commaSplittedCommands)
+{
+	_scopeCommands = commaSplittedCommands;
+}
+
+NC_ARGPARSE_INLINE bool ArgParser::_isScopeCommand(const char* arg)
+{
+	return _scopeCommands != NULL && _isSubcommand(_scopeCommands, arg, strlen(arg));
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setLazyParsing(bool lazy)
+{
+	_lazyParsing = lazy;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setCaseInsensitiveKeys(bool enabled)
+{
+	_caseInsensitiveKeys = enabled;
+	_setCaseInsensitive(enabled || _syntaxCaseInsensitive);
+}
+
+static forceinline void _swapNames(const char**& names, const char**& otherNames)
+{
+	const char** t = names;
+	names = otherNames;
+	otherNames = t;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_setCaseInsensitive(bool enabled)
+{
+	if (enabled == _caseInsensitive)
+		return;
+	_caseInsensitive = enabled;
+	_prefixIndexDirty = _prefixMatching;
+	_invalidateCache();
+
+	// every name of the schema has been folded as it was given, the spellings change places
+	_swapNames(_shortNames, _otherShortNames);
+	_swapNames(_shortNameValues, _otherShortNameValues);
+	_swapNames(_defaultKeys, _otherDefaultKeys);
+	_swapNames(_optionNames, _otherOptionNames);
+	_swapNames(_valueNumberKeys, _otherValueNumberKeys);
+	_swapNames(_choiceKeys, _otherChoiceKeys);
+
+	if (enabled)
+	{
+		for (size_t i = 0; i < _keyValueNumber; i++)
+			_foldedKeys[i] = _foldName(_keys[i], _keyLengths[i], _arena);
+	}
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_setSchemaName(const char*& name, const char*& otherName, const char* newName, size_t length)
+{
+	const char* foldedName = _foldName(newName, length, _schemaArena);
+	name = _caseInsensitive ? foldedName : newName;
+	otherName = _caseInsensitive ? newName : foldedName;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setUtf8Validation(bool enabled)
+{
+	_validateUtf8 = enabled;
+}
+
+static forceinline bool _hasUpperCase(const char* name, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		if (name[i] >= 'A' && name[i] <= 'Z')
+			return true;
+	}
+	return false;
+}
+
+static forceinline void _foldCopy(char* folded, const char* name, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+		folded[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i] + ('a' - 'A') : name[i];
+	folded[length] = '\0';
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::_foldName(const char* name, size_t length, ArgArena& arena)
+{
+	// most names are lower case already and are kept as they are
+	if (!_hasUpperCase(name, length))
+		return name;
+
+	char* folded = (char*)arena.allocate(length + 1);
+	if (folded == NULL)
+	{
+		_reportOutOfMemory();
+		return name;
+	}
+	_foldCopy(folded, name, length);
+	return folded;
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::_foldInto(const char* key, size_t keyLength, char (&buffer)[64])
+{
+	if (!_hasUpperCase(key, keyLength))
+		return key;
+	if (keyLength >= sizeof(buffer))
+		return _foldName(key, keyLength, _arena);
+	_foldCopy(buffer, key, keyLength);
+	return buffer;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::addOption(const char* name)
+{
+	char buffer[64];
+	size_t length = strlen(name);
+	const char* foldedName = _foldQuery(name, length, buffer);
+	for (size_t i = 0; i < _optionNameNumber; i++)
+	{
+		if (strcmp(_optionNames[i], foldedName) == 0)
+			return;
+	}
+
+	if (!_reserve(_optionNameColumns, _optionNameNumber, _optionNameNumber + 1, _optionNames, _otherOptionNames))
+		return;
+
+	_setSchemaName(_optionNames[_optionNameNumber], _otherOptionNames[_optionNameNumber], name, length);
+	_optionNameNumber++;
+	_prefixIndexDirty = _prefixMatching;
+	_invalidateCache();
+}
+
+static int _compareNames(const void* a, const void* b)
+{
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_rebuildPrefixIndex()
+{
+	_prefixIndexDirty = false;
+	_invalidateCache();
+	_tokenizeAll();	// the prefixes are resolved in one pass
+
+	if (!_reserve(_sortedNameColumns, 0, _optionNameNumber + _shortNameNumber * 2 + _defaultNumber, _sortedNames))
+		return;
+
+	size_t n = 0;
+	for (size_t i = 0; i < _optionNameNumber; i++)
+		_sortedNames[n++] = _optionNames[i];
+	for (size_t i = 0; i < _shortNameNumber; i++)
+	{
+		_sortedNames[n++] = _shortNames[i];
+		_sortedNames[n++] = _shortNameValues[i];
+	}
+	for (size_t i = 0; i < _defaultNumber; i++)
+		_sortedNames[n++] = _defaultKeys[i];
+
+	qsort(_sortedNames, n, sizeof(_sortedNames[0]), _compareNames);
+	_sortedNameNumber = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (_sortedNameNumber == 0 || strcmp(_sortedNames[_sortedNameNumber - 1], _sortedNames[i]) != 0)
+			_sortedNames[_sortedNameNumber++] = _sortedNames[i];
+	}
+
+	for (size_t i = 0; i < _keyValueNumber; i++)
+	{
+		if (m_argv[_keyArgIndex[i]][1] != '-')	// not a "--" argument, a resolved one is an exact match below
+			continue;
+		const char* key = _caseInsensitive ? _foldedKeys[i] : _keys[i];
+		size_t keyLength = _keyLengths[i];
+
+		// lower bound: the first name not less than the key
+		size_t lo = 0, hi = _sortedNameNumber;
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (strcmp(_sortedNames[mid], key) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo == _sortedNameNumber || strncmp(_sortedNames[lo], key, keyLength) != 0
+			|| _sortedNames[lo][keyLength] == '\0')	// unknown, or an exact match
+			continue;
+
+		if (lo + 1 < _sortedNameNumber && strncmp(_sortedNames[lo + 1], key, keyLength) == 0)
+		{
+			if (!_keyAmbiguous[i])
+				_sink->report(ArgError_ambiguousArgument, key, "Ambiguous argument");
+			_keyAmbiguous[i] = true;
+			continue;
+		}
+
+		_keys[i] = _sortedNames[lo];
+		_foldedKeys[i] = _sortedNames[lo];
+		_keyLengths[i] = strlen(_keys[i]);
+		_keyAmbiguous[i] = false;
+	}
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setValueNumber(const char* key, size_t number)
+{
+	char buffer[64];
+	size_t keyLength = strlen(key);
+	const char* foldedKey = _foldQuery(key, keyLength, buffer);
+	for (size_t i = 0; i < _valueNumberNumber; i++)
+	{
+		if (strcmp(_valueNumberKeys[i], foldedKey) == 0)
+		{
+			_valueNumbers[i] = number;
+			return;
+		}
+	}
+
+	if (!_reserve(_valueNumberColumns, _valueNumberNumber, _valueNumberNumber + 1, _valueNumberKeys, _otherValueNumberKeys, _valueNumbers))
+		return;
+
+	_setSchemaName(_valueNumberKeys[_valueNumberNumber], _otherValueNumberKeys[_valueNumberNumber], key, keyLength);
+	_valueNumbers[_valueNumberNumber] = number;
+	_valueNumberNumber++;
+}
+
+NC_ARGPARSE_INLINE size_t ArgParser::_getValueNumber(const char* key, size_t keyLength, size_t defaultNumber)
+{
+	size_t aliaseLength = 0;
+	const char* aliaseName = _getAliaseName(key, keyLength, &aliaseLength);
+	for (size_t i = 0; i < _valueNumberNumber; i++)
+	{
+		size_t length = strlen(_valueNumberKeys[i]);
+		if (_equals(key, keyLength, _valueNumberKeys[i], length)
+			|| (aliaseName != NULL && _equals(aliaseName, aliaseLength, _valueNumberKeys[i], length)))
+			return _valueNumbers[i];
+	}
+	return defaultNumber;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::parse(int argc, char* argv[])
+{
+	parse<PosixArgSyntax>(argc, argv);
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_parse(int argc, char* argv[])
+{
+	// the invocation starts, the caller tokenizes
+	reset();
+	_setCaseInsensitive(_caseInsensitiveKeys || _syntaxCaseInsensitive);
+	_argPool = _pool;
+	m_argc = argc;
+	m_argv = argv;
+	_nextArgIndex = 1;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::reparse(int argc, char* argv[], int firstChangedArg)
+{
+	if (firstChangedArg > _nextArgIndex)	// lazy parsing may not have come that far
+		firstChangedArg = _nextArgIndex;
+	// another syntax copies the keys with an inline value into the arena, reset() frees them
+	if (m_argv == NULL || firstChangedArg <= 1 || _argPool != _pool || _tokenizer != NULL)
+	{
+		_parse(argc, argv);
+		_startTokenizing();
+		return;
+	}
+
+	// put back the subcommand taken by getSubcommand(), unless it ended the scope
+	if (_subcommandParsed && _subcommand != NULL && _subcommandArgc == 0)
+	{
+		memmove(_freeOptions + 1, _freeOptions, sizeof(_freeOptions[0]) * _freeOptionNumber);
+		memmove(_wideFreeOptions + 1, _wideFreeOptions, sizeof(_wideFreeOptions[0]) * _freeOptionNumber);
+		_freeOptions[0] = (char*)_subcommand;
+		_wideFreeOptions[0] = NULL;
+		_freeOptionNumber++;
+	}
+
+	// A key is kept if the entry that ended its values is before the edit,
+	// otherwise an appended entry could become one of its values.
+	size_t keyNumber = 0;
+	size_t keyEntryNumber = 0;
+	while (keyNumber < _keyValueNumber && _keyArgIndex[keyNumber] + (int)_keyValueCount[keyNumber] + 1 < firstChangedArg)
+	{
+		keyEntryNumber += 1 + _keyValueCount[keyNumber];
+		keyNumber++;
+	}
+	int nextArgIndex = firstChangedArg;
+	if (keyNumber < _keyValueNumber && _keyArgIndex[keyNumber] < nextArgIndex)
+		nextArgIndex = _keyArgIndex[keyNumber];
+
+	// the stamps and the lookup cache of the kept keys become stale like in parse()
+	reset();
+	m_argc = argc;
+	m_argv = argv;
+	_keyValueNumber = keyNumber;
+	_freeOptionNumber = (size_t)(nextArgIndex - 1) - keyEntryNumber;
+	_nextArgIndex = nextArgIndex;
+
+	// the arena is cleared: the folded keys and the interned values are made again, the wide views on demand
+	_argPool = _pool;
+	for (size_t i = 0; i < _keyValueNumber; i++)
+	{
+		if (_caseInsensitive)
+			_foldedKeys[i] = _foldName(_keys[i], _keyLengths[i], _arena);
+		if (_argPool != NULL)
+			_internMoreValues(i);
+		_wideValues[i] = NULL;
+	}
+	for (size_t i = 0; i < _freeOptionNumber; i++)
+		_wideFreeOptions[i] = NULL;
+	_startTokenizing();
+}
+
+NC_ARGPARSE_INLINE void ArgParser::parseScope(ArgParser* parent)
 {
-	_defaultNumber = 0;
-	_shortNameNumber = 0;
-	_unknownArgIter = 0;
-	_subcommandParsed = false;
-	_subcommand = NULL;
+	ArgProfileScope profile("parseScope");
+	parent->_tokenizeAll();
+
+	// argv[0] of the scope is the subcommand
+	reset();
+	_tokenizer = parent->_tokenizer;
+	_syntaxCaseInsensitive = parent->_syntaxCaseInsensitive;
+	_setCaseInsensitive(_caseInsensitiveKeys || _syntaxCaseInsensitive);
+	_argPool = _pool;
+	m_argc = parent->_subcommandArgc;
+	m_argv = parent->m_argv + parent->m_argc;
+	_parent = parent;
+	_parentCacheGeneration = _parentChainGeneration();
+	_nextArgIndex = 1;
+	_startTokenizing();
 }
 
-void ArgParser::bindAliaseName(const char* name1, const char* name2)
+NC_ARGPARSE_INLINE void ArgParser::_startTokenizing()
 {
-	_shortNames[_shortNameNumber] = name1;
-	_shortNameValues[_shortNameNumber] = name2;
-	_shortNameNumber++;
+	// lazy: the queries tokenize what they need, the choices are resolved by getChoice()
+	if (_lazyParsing)
+		return;
+
+	_tokenizeAll();
+	_resolveChoices();
 }
 
-const char* ArgParser::getAliaseName(const char* key)
+NC_ARGPARSE_INLINE void ArgParser::_tokenizeRest()
 {
-	for (size_t i = 0; i < _shortNameNumber; i++)
+	if (_tokenizer == NULL)
+		_tokenizeAllWith<PosixArgSyntax>();
+	else
 	{
-		if (strcmp(key, _shortNames[i]) == 0)
-		{
-			return _shortNameValues[i];
-		}
-		else if (strcmp(key, _shortNameValues[i]) == 0)
+		while (_nextArgIndex < m_argc)
+			(this->*_tokenizer)();
+	}
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_tokenizeNext()
+{
+	if (_tokenizer == NULL)
+		_tokenizeNextWith<PosixArgSyntax>();
+	else
+		(this->*_tokenizer)();
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_resolveChoices()
+{
+	for (size_t i = 0; i < _choiceOptionNumber; i++)
+		_resolveChoice(i);
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::getArg(const char* key)
+{
+	return _getArg(key, strlen(key));
+}
+
+NC_ARGPARSE_INLINE size_t ArgParser::_findKey(const char* key, size_t keyLength)
+{
+	_resolvePrefixes();
+	char buffer[64];
+	key = _foldQuery(key, keyLength, buffer);
+	const char** keys = _caseInsensitive ? _foldedKeys : _keys;
+	for (size_t i = 0; i < _keyValueNumber; i++)
+	{
+		if (_equals(key, keyLength, keys[i], _keyLengths[i]))
+			return i;
+	}
+
+	// lazy parsing: go on only until the first match. A miss has seen the whole argv,
+	// so the lookup cache stays valid as the tokens grow.
+	while (_nextArgIndex < m_argc)
+	{
+		size_t i = _keyValueNumber;
+		_tokenizeNext();
+		// the columns may have grown
+		if (i != _keyValueNumber && _equals(key, keyLength, _caseInsensitive ? _foldedKeys[i] : _keys[i], _keyLengths[i]))
+			return i;
+	}
+	return _keyValueNumber;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_invalidateCache()
+{
+	if (++_cacheGeneration == 0)
+	{
+		memset(_lookupCache, 0, sizeof(_lookupCache));
+		_cacheGeneration = 1;
+	}
+}
+
+NC_ARGPARSE_INLINE uint32_t ArgParser::_parentChainGeneration()
+{
+	uint32_t generation = 0;
+	for (ArgParser* p = _parent; p != NULL; p = p->_parent)
+		generation = generation * 31 + p->_cacheGeneration;
+	return generation;
+}
+
+NC_ARGPARSE_INLINE const char* ArgParser::_getArg(const char* key, size_t keyLength, size_t* keyIndex)
+{
+	_resolvePrefixes();
+	NC_ARGPARSE_COUNT(_memory.stats.lookups++);
+
+	// a reparse or a schema change of a parent makes the values cached from it stale
+	if (_parent != NULL)
+	{
+		uint32_t parentGeneration = _parentChainGeneration();
+		if (parentGeneration != _parentCacheGeneration)
 		{
-			return _shortNames[i];
+			_parentCacheGeneration = parentGeneration;
+			_invalidateCache();
 		}
 	}
 
-	return NULL;
+	// The callers usually pass the same literals again and again, so the pointer picks the slot.
+	// The hash guards against a buffer that was reused for another key.
+	uint32_t hash = _hash(key, keyLength);
+	LookupCacheEntry& e = _lookupCache[(hash ^ (uint32_t)((uintptr_t)key >> 3)) & (LOOKUP_CACHE_SIZE - 1)];
+	if (e.generation == _cacheGeneration && e.key == key && e.keyLength == keyLength && e.hash == hash)
+	{
+		NC_ARGPARSE_COUNT(_memory.stats.cacheHits++);
+		NC_ARGPARSE_COUNT(_memory.stats.defaultHits += e.keyIndex == NO_KEY && e.value != NULL);
+		if (e.keyIndex < OUTER_KEY)
+			_markUsed(e.keyIndex);
+		*keyIndex = e.keyIndex;
+		return e.value;
+	}
+	NC_ARGPARSE_COUNT(_memory.stats.hashCollisions += e.generation == _cacheGeneration);
+
+	const char* value = _getArgWithParent(key, keyLength, keyIndex);
+	NC_ARGPARSE_COUNT(_memory.stats.defaultHits += *keyIndex == NO_KEY && value != NULL);
+	e.key = key;
+	e.keyLength = keyLength;
+	e.hash = hash;
+	e.generation = _cacheGeneration;
+	e.value = value;
+	e.keyIndex = *keyIndex;
+	return value;
 }
 
-void ArgParser::setDefault(const char* key, const char* v)
+NC_ARGPARSE_INLINE const char* ArgParser::_getArgWithParent(const char* key, size_t keyLength, size_t* keyIndex)
 {
-	_defaultKeys[_defaultNumber] = key;
-	_defaultValues[_defaultNumber] = v;
-	_defaultNumber++;
+	const char* value = _getArgWithAliase(key, keyLength, true, keyIndex);
+	if (*keyIndex != NO_KEY || _parent == NULL)
+		return value;
+
+	// an argument of an outer scope comes before a default of this one, and is used there
+	size_t parentKeyIndex;
+	const char* parentValue = _parent->_getArgWithParent(key, keyLength, &parentKeyIndex);
+	if (parentKeyIndex != NO_KEY)
+	{
+		*keyIndex = OUTER_KEY;
+		return parentValue;
+	}
+	return value != NULL ? value : parentValue;
 }
 
-const char* ArgParser::getDefault(const char* key)
+NC_ARGPARSE_INLINE const char* ArgParser::_getArgWithAliase(const char* key, size_t keyLength, bool useAliase, size_t* keyIndex)
 {
-	for (size_t i = 0; i < _defaultNumber; i++)
+	size_t i = _findKey(key, keyLength);
+	if (i != _keyValueNumber)
+	{
+		_markUsed(i);
+		*keyIndex = i;
+		return _values[i];
+	}
+
+	if (useAliase)
 	{
-		if (strcmp(key, _defaultKeys[i]) == 0)
+		size_t aliaseLength = 0;
+		const char* aliaseName = _getAliaseName(key, keyLength, &aliaseLength);
+		if (aliaseName != NULL)
 		{
-			return _defaultValues[i];
+			const char* value = _getArgWithAliase(aliaseName, aliaseLength, false, keyIndex);
+			if (value != NULL)
+				return value;
 		}
 	}
 
+	*keyIndex = NO_KEY;
+
+	const char* defaultValue = _getDefault(key, keyLength);
+	if (defaultValue)
+		return defaultValue;
+
 	return NULL;
 }
 
-void ArgParser::parse(int argc, char* argv[])
+NC_ARGPARSE_INLINE ArgSource ArgParser::getArgSource(const char* key)
 {
-	m_argc = argc;
-	m_argv = argv;
-	_keyValueNumber = 0;
-	_freeOptionNumber = 0;
+	size_t keyLength = strlen(key);
+	if (_findKey(key, keyLength) != _keyValueNumber)
+		return ArgSource_argv;
+
+	size_t aliaseLength = 0;
+	const char* aliaseName = _getAliaseName(key, keyLength, &aliaseLength);
+	if (aliaseName != NULL && _findKey(aliaseName, aliaseLength) != _keyValueNumber)
+		return ArgSource_alias;
+
+	if (_getDefault(key, keyLength) != NULL || (aliaseName != NULL && _getDefault(aliaseName, aliaseLength) != NULL))
+		return ArgSource_default;
+
+	return ArgSource_none;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::bindChoices(const char* key, const ArgChoice* choices, size_t choiceNumber)
+{
+	char buffer[64];
+	size_t keyLength = strlen(key);
+	const char* foldedKey = _foldQuery(key, keyLength, buffer);
+	size_t i = 0;
+	while (i < _choiceOptionNumber && strcmp(_choiceKeys[i], foldedKey) != 0)
+		i++;
 
-	for (int i = 1; i < argc; i++)
+	if (i == _choiceOptionNumber)
 	{
-		if (argv[i][0] == '-')
-		{
-			if (argv[i][1] == '-')
-				_keys[_keyValueNumber] = argv[i] + 2; // --version
-			else
-				_keys[_keyValueNumber] = argv[i] + 1;	// -v
+		if (!_reserve(_choiceOptionColumns, _choiceOptionNumber, _choiceOptionNumber + 1, _choiceKeys, _otherChoiceKeys, _choiceTables, _choiceNumbers, _choiceCodes, _choiceStamps))
+			return;
+		_choiceOptionNumber++;
+		_setSchemaName(_choiceKeys[i], _otherChoiceKeys[i], key, keyLength);
+	}
+	else if (_choiceTables[i] == choices && _choiceStamps[i] == _generation)
+		return;	// a pooled parser binds the same choices for every invocation
+	else if (_choiceKeys[i] != key && _otherChoiceKeys[i] != key)
+		_setSchemaName(_choiceKeys[i], _otherChoiceKeys[i], key, keyLength);
 
-			if (i + 1 < argc && argv[i + 1][0] != '-')
-			{
-				_values[_keyValueNumber] = argv[i + 1];
-				i++;
-			}
-			else
-				_values[_keyValueNumber] = "";
+	_choiceTables[i] = choices;
+	_choiceNumbers[i] = choiceNumber;
+	_choiceStamps[i] = 0;
+	if (m_argv != NULL)
+		_resolveChoice(i);
+}
 
-			_keyUsed[_keyValueNumber] = false;
+NC_ARGPARSE_INLINE void ArgParser::_resolveChoice(size_t i)
+{
+	_choiceStamps[i] = _generation;
+	_choiceCodes[i] = INT_MIN;
 
-			_keyValueNumber++;
-		}
-		else
+	const char* value = getArg(_choiceKeys[i]);
+	if (value == NULL)
+		return;
+
+	const ArgChoice* choices = _choiceTables[i];
+	size_t valueLength = strlen(value);
+	for (size_t j = 0; j < _choiceNumbers[i]; j++)
+	{
+		if (strncmp(choices[j].name, value, valueLength) == 0 && choices[j].name[valueLength] == '\0')
 		{
-			_freeOptions[_freeOptionNumber++] = argv[i];
+			_choiceCodes[i] = choices[j].value;
+			return;
 		}
 	}
+
+	// the message lives in the arena, the sink copies it if it keeps it
+	size_t messageSize = sizeof("Invalid value (expected )");
+	for (size_t j = 0; j < _choiceNumbers[i]; j++)
+		messageSize += strlen(choices[j].name) + 1;
+
+	char* message = (char*)_arena.allocate(messageSize);
+	if (message == NULL)
+	{
+		_sink->report(ArgError_invalidValue, _choiceKeys[i], "Invalid value");
+		return;
+	}
+
+	ArgTextWriter w(message, messageSize);
+	w.append("Invalid value (expected ");
+	for (size_t j = 0; j < _choiceNumbers[i]; j++)
+	{
+		if (j != 0)
+			w.append("|");
+		w.append(choices[j].name);
+	}
+	w.append(")");
+	_sink->report(ArgError_invalidValue, _choiceKeys[i], message);
+}
+
+NC_ARGPARSE_INLINE int ArgParser::getChoice(const char* key, int missingValue)
+{
+	char buffer[64];
+	key = _foldQuery(key, strlen(key), buffer);
+	for (size_t i = 0; i < _choiceOptionNumber; i++)
+	{
+		if (strcmp(_choiceKeys[i], key) != 0)
+			continue;
+
+		if (_choiceStamps[i] != _generation)
+			_resolveChoice(i);
+		return _choiceCodes[i] != INT_MIN ? _choiceCodes[i] : missingValue;
+	}
+	return missingValue;
+}
+
+static size_t _pieceNumber(const char* value, char separator)
+{
+	size_t n = 1;
+	if (separator != '\0')
+	{
+		for (const char* p = value; *p != '\0'; p++)
+			n += *p == separator;
+	}
+	return n;
 }
 
-const char* ArgParser::getArg(const char* key)
+NC_ARGPARSE_INLINE ArgValues ArgParser::getAll(const char* key, char separator)
 {
-	return _getArgWithAliase(key, true);
+	return _getAll(key, strlen(key), separator);
 }
 
-const char* ArgParser::_getArgWithAliase(const char* key, bool useAliase)
+NC_ARGPARSE_INLINE ArgValues ArgParser::_getAll(const char* key, size_t keyLength, char separator)
 {
+	_resolvePrefixes();
+	_tokenizeAll();
+	char buffer[64];
+	key = _foldQuery(key, keyLength, buffer);
+	const char** keys = _caseInsensitive ? _foldedKeys : _keys;
+	size_t aliaseLength = 0;
+	const char* aliaseName = _getAliaseName(key, keyLength, &aliaseLength);
+	const char* defaultValue = NULL;
+
+	// first pass: count, so the values can be stored contiguously
+	size_t number = 0;
+	size_t textSize = 0;
 	for (size_t i = 0; i < _keyValueNumber; i++)
 	{
-		if (strcmp(key, _keys[i]) == 0)
+		if (!_equals(keys[i], _keyLengths[i], key, keyLength)
+			&& (aliaseName == NULL || !_equals(keys[i], _keyLengths[i], aliaseName, aliaseLength)))
+			continue;
+
+		_markUsed(i);
+		size_t count = _keyValueCount[i] != 0 ? _keyValueCount[i] : 1;
+		for (size_t j = 0; j < count; j++)
 		{
-			_keyUsed[i] = true;
-			return _values[i];
+			const char* v = _valueOf(i, j);
+			number += _pieceNumber(v, separator);
+			if (separator != '\0')
+				textSize += strlen(v) + 1;
 		}
 	}
 
-	if (useAliase)
+	if (number == 0)
 	{
-		const char* aliaseName = getAliaseName(key);
-		if (aliaseName != NULL)
+		defaultValue = _getDefault(key, keyLength);
+		if (defaultValue == NULL && aliaseName != NULL)
+			defaultValue = _getDefault(aliaseName, aliaseLength);
+		if (defaultValue == NULL)
 		{
-			const char* value = _getArgWithAliase(aliaseName, false);
-			if (value != NULL)
-				return value;
+			ArgValues none = { NULL, 0 };
+			return none;
 		}
+		number = _pieceNumber(defaultValue, separator);
+		if (separator != '\0')
+			textSize = strlen(defaultValue) + 1;
 	}
 
-	const char* defaultValue = getDefault(key);
-	if (defaultValue)
-		return defaultValue;
+	const char** values = (const char**)_arena.allocate(sizeof(const char*) * number + textSize);
+	if (values == NULL)
+	{
+		_reportOutOfMemory();
+		ArgValues none = { NULL, 0 };
+		return none;
+	}
+	char* text = (char*)(values + number);
+	size_t n = 0;
 
-	return NULL;
+	// second pass: fill
+	for (size_t i = 0; i < _keyValueNumber || defaultValue != NULL; i++)
+	{
+		size_t count = 1;
+		if (defaultValue == NULL)
+		{
+			if (!_equals(keys[i], _keyLengths[i], key, keyLength)
+				&& (aliaseName == NULL || !_equals(keys[i], _keyLengths[i], aliaseName, aliaseLength)))
+				continue;
+			count = _keyValueCount[i] != 0 ? _keyValueCount[i] : 1;
+		}
+
+		for (size_t j = 0; j < count; j++)
+		{
+			const char* v = defaultValue != NULL ? defaultValue : _valueOf(i, j);
+			if (separator == '\0')
+			{
+				values[n++] = v;
+				continue;
+			}
+
+			for (;;)
+			{
+				const char* end = strchr(v, separator);
+				size_t length = end != NULL ? (size_t)(end - v) : strlen(v);
+				memcpy(text, v, length);
+				text[length] = '\0';
+				values[n++] = text;
+				text += length + 1;
+				if (end == NULL)
+					break;
+				v = end + 1;
+			}
+		}
+
+		if (defaultValue != NULL)
+			break;
+	}
+
+	ArgValues r = { values, number };
+	return r;
 }
 
-const char* ArgParser::getArg(const char* key1, const char* key2)
+NC_ARGPARSE_INLINE const char* ArgParser::getArg(const char* key1, const char* key2)
 {
 	const char* v = getArg(key1);
 	if (v == NULL)
@@ -153,34 +1334,232 @@ const char* ArgParser::getArg(const char* key1, const char* key2)
 	return v;
 }
 
-bool ArgParser::hasArg(const char* key)
+NC_ARGPARSE_INLINE bool ArgParser::hasArg(const char* key)
 {
 	return getArg(key) != NULL;
 }
 
-bool ArgParser::hasArg(const char* key1, const char* key2)
+NC_ARGPARSE_INLINE bool ArgParser::hasArg(const char* key1, const char* key2)
 {
 	return hasArg(key1) || hasArg(key2);
 }
 
-bool ArgParser::argEquals(const char* key, const char* value)
+NC_ARGPARSE_INLINE bool ArgParser::argEquals(const char* key, const char* value)
+{
+	return _argEquals(key, strlen(key), value, strlen(value));
+}
+
+NC_ARGPARSE_INLINE bool ArgParser::_argEquals(const char* key, size_t keyLength, const char* value, size_t valueLength)
+{
+	const char* v = _getArg(key, keyLength);
+	return v != NULL && strncmp(v, value, valueLength) == 0 && v[valueLength] == '\0';
+}
+
+static const uint32_t INVALID_UTF8 = 0xFFFFFFFF;
+
+// Decodes the sequence at p, an invalid one gives INVALID_UTF8 and skips a byte.
+static forceinline uint32_t _decodeUtf8(const unsigned char*& p, const unsigned char* end)
+{
+	uint32_t c = *p++;
+	if (c < 0x80)
+		return c;
+
+	size_t n;
+	uint32_t min;
+	if ((c & 0xE0) == 0xC0)
+		n = 1, c &= 0x1F, min = 0x80;
+	else if ((c & 0xF0) == 0xE0)
+		n = 2, c &= 0x0F, min = 0x800;
+	else if ((c & 0xF8) == 0xF0)
+		n = 3, c &= 0x07, min = 0x10000;
+	else
+		return INVALID_UTF8;
+
+	const unsigned char* q = p;
+	for (size_t i = 0; i < n; i++, q++)
+	{
+		if (q == end || (*q & 0xC0) != 0x80)
+			return INVALID_UTF8;
+		c = (c << 6) | (*q & 0x3F);
+	}
+	// overlong, a surrogate, or out of range
+	if (c < min || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+		return INVALID_UTF8;
+	p = q;
+	return c;
+}
+
+NC_ARGPARSE_INLINE bool ArgParser::isValidUtf8(const char* text, size_t length)
+{
+	const unsigned char* p = (const unsigned char*)text;
+	const unsigned char* end = p + length;
+	while (p != end)
+	{
+		if (*p < 0x80)
+			p++;
+		else if (_decodeUtf8(p, end) == INVALID_UTF8)
+			return false;
+	}
+	return true;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_checkUtf8(const char* arg)
+{
+	if (!isValidUtf8(arg, strlen(arg)))
+		_sink->report(ArgError_invalidEncoding, arg, "Invalid UTF-8");
+}
+
+NC_ARGPARSE_INLINE const wchar_t* ArgParser::_toWide(const char* text)
+{
+	const unsigned char* begin = (const unsigned char*)text;
+	const unsigned char* end = begin + strlen(text);
+	const bool utf16 = sizeof(wchar_t) == 2;
+
+	// first pass: count, a code point above the BMP takes a surrogate pair in UTF-16
+	size_t number = 0;
+	for (const unsigned char* p = begin; p != end; )
+	{
+		uint32_t c = _decodeUtf8(p, end);
+		number += utf16 && c != INVALID_UTF8 && c >= 0x10000 ? 2 : 1;
+	}
+
+	wchar_t* wide = (wchar_t*)_arena.allocate(sizeof(wchar_t) * (number + 1));
+	if (wide == NULL)
+	{
+		_reportOutOfMemory();
+		return NULL;
+	}
+
+	wchar_t* w = wide;
+	for (const unsigned char* p = begin; p != end; )
+	{
+		uint32_t c = _decodeUtf8(p, end);
+		if (c == INVALID_UTF8)
+			c = 0xFFFD;
+		if (utf16 && c >= 0x10000)
+		{
+			*w++ = (wchar_t)(0xD800 + ((c - 0x10000) >> 10));
+			*w++ = (wchar_t)(0xDC00 + ((c - 0x10000) & 0x3FF));
+		}
+		else
+			*w++ = (wchar_t)c;
+	}
+	*w = L'\0';
+	return wide;
+}
+
+NC_ARGPARSE_INLINE const wchar_t* ArgParser::getArgW(const char* key)
+{
+	size_t keyIndex;
+	const char* value = _getArgWithParent(key, strlen(key), &keyIndex);
+	if (value == NULL)
+		return NULL;
+	if (keyIndex == OUTER_KEY)
+		return _parent->getArgW(key);
+	if (keyIndex == NO_KEY)
+		return _getDefaultWide(value);
+
+	if (_wideValues[keyIndex] == NULL)
+		_wideValues[keyIndex] = _toWide(value);
+	return _wideValues[keyIndex];
+}
+
+NC_ARGPARSE_INLINE const wchar_t* ArgParser::_getDefaultWide(const char* value)
+{
+	for (size_t i = 0; i < _defaultNumber; i++)
+	{
+		if (_defaultValues[i] != value)
+			continue;
+		if (_defaultWideStamps[i] != _generation)
+		{
+			_defaultWideValues[i] = _toWide(value);
+			_defaultWideStamps[i] = _generation;
+		}
+		return _defaultWideValues[i];
+	}
+
+	// a default of an outer scope
+	return _parent != NULL ? _parent->_getDefaultWide(value) : _toWide(value);
+}
+
+NC_ARGPARSE_INLINE const wchar_t* ArgParser::getPositionalArgByIndexW(size_t i)
+{
+	_tokenizeAll();
+	if (_wideFreeOptions[i] == NULL)
+		_wideFreeOptions[i] = _toWide(_freeOptions[i]);
+	return _wideFreeOptions[i];
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setStringPool(ArgStringPool* pool)
+{
+	_pool = pool;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_internArg(size_t i)
+{
+	const char* key = _keys[i];
+	ArgStringId keyId = _argPool->intern(key, _keyLengths[i]);
+	if (keyId != 0)
+		_keys[i] = _argPool->string(keyId);
+	if (_caseInsensitive && _foldedKeys[i] == key)
+		_foldedKeys[i] = _keys[i];
+
+	_valueIds[i] = _argPool->intern(_values[i]);
+	if (_valueIds[i] != 0)
+		_values[i] = _argPool->string(_valueIds[i]);
+	_internMoreValues(i);
+}
+
+NC_ARGPARSE_INLINE void ArgParser::_internMoreValues(size_t i)
+{
+	// the values of setValueNumber() after the first, the array is in the arena
+	_moreValues[i] = NULL;
+	size_t count = _keyValueCount[i];
+	if (count < 2)
+		return;
+
+	const char** values = (const char**)_arena.allocate(sizeof(const char*) * (count - 1));
+	if (values == NULL)
+	{
+		_reportOutOfMemory();
+		return;
+	}
+	for (size_t j = 1; j < count; j++)
+	{
+		const char* value = m_argv[_keyArgIndex[i] + 1 + j];
+		ArgStringId id = _argPool->intern(value);
+		values[j - 1] = id != 0 ? _argPool->string(id) : value;
+	}
+	_moreValues[i] = values;
+}
+
+NC_ARGPARSE_INLINE ArgStringId ArgParser::getArgId(const char* key)
 {
-	const char* v = getArg(key);
-	return v != NULL && strcmp(v, value) == 0;
+	size_t keyIndex;
+	const char* value = _getArg(key, strlen(key), &keyIndex);
+	if (value == NULL || _argPool == NULL)
+		return 0;
+	if (keyIndex < OUTER_KEY)
+		return _valueIds[keyIndex];
+	return _argPool->find(value, strlen(value));	// a default, or an argument of the parent scope
 }
 
-bool ArgParser::hasUnknownArgs() 
+NC_ARGPARSE_INLINE bool ArgParser::hasUnknownArgs() 
 {
+	_resolvePrefixes();
+	_tokenizeAll();
 	for (size_t i = 0; i < _keyValueNumber; i++)
 	{
-		if (!_keyUsed[i])
+		if (!_isUsed(i))
 			return true;
 	}
 	return false;
 }
 
-const char* ArgParser::nextUnknownArg() {
-	while (_unknownArgIter != _keyValueNumber && _keyUsed[_unknownArgIter])
+NC_ARGPARSE_INLINE const char* ArgParser::nextUnknownArg() {
+	_resolvePrefixes();
+	_tokenizeAll();
+	while (_unknownArgIter != _keyValueNumber && _isUsed(_unknownArgIter))
 		_unknownArgIter++;
 
 	if (_unknownArgIter == _keyValueNumber)
@@ -189,40 +1568,154 @@ const char* ArgParser::nextUnknownArg() {
 		return _keys[_unknownArgIter++];
 }
 
-void ArgParser::resetUnknownArgIterator() {
+NC_ARGPARSE_INLINE void ArgParser::resetUnknownArgIterator() {
 	_unknownArgIter = 0;
 }
 
-bool ArgParser::printUnknownArgs() {
+NC_ARGPARSE_INLINE bool ArgParser::printUnknownArgs() {
 	const char* unknownArg;
 	bool has = false;
 	resetUnknownArgIterator();
 	while ((unknownArg = nextUnknownArg()) != NULL)
 	{
 		has = true;
-		printf("error: Unknown argument: %s\n", unknownArg);
+		_sink->report(ArgError_unknownArgument, unknownArg, "Unknown argument");
 	}
 
 	return has;
 }
 
-static bool _isSubcommand(const char* commaSplittedCommands, const char* subcommand)
+static void _dumpOption(ArgTextWriter& w, bool& first, const char* key, const char* value, const char* source)
+{
+	if (!first)
+		w.append(",");
+	first = false;
+	w.append("{\"key\":");
+	w.appendJsonString(key);
+	w.append(",\"value\":");
+	w.appendJsonString(value);
+	w.append(",\"source\":\"");
+	w.append(source);
+	w.append("\"}");
+}
+
+// the slot of the key in an open-addressing table of key indexes + 1, 0 when the key is absent
+static size_t* _findKeySlot(size_t* slots, size_t mask, const char** keys, const size_t* keyLengths, const char* key, size_t keyLength)
+{
+	size_t i = _hash(key, keyLength) & mask;
+	while (slots[i] != 0 && !_equals(keys[slots[i] - 1], keyLengths[slots[i] - 1], key, keyLength))
+		i = (i + 1) & mask;
+	return &slots[i];
+}
+
+NC_ARGPARSE_INLINE size_t ArgParser::dumpJson(char* buffer, size_t bufferSize)
+{
+	_tokenizeAll();
+	_resolvePrefixes();
+	ArgTextWriter w(buffer, bufferSize);
+	bool first = true;
+
+	// index the first occurrences, so the repeated keys are skipped in one pass
+	const char** keys = _caseInsensitive ? _foldedKeys : _keys;
+	size_t slotNumber = 16;
+	while (slotNumber < _keyValueNumber * 2)
+		slotNumber *= 2;
+	size_t mask = slotNumber - 1;
+	size_t* slots = (size_t*)_arena.allocate(sizeof(size_t) * slotNumber);
+	if (slots == NULL)
+	{
+		_reportOutOfMemory();
+		return 0;
+	}
+	memset(slots, 0, sizeof(size_t) * slotNumber);
+
+	w.append("{\"options\":[");
+	for (size_t i = 0; i < _keyValueNumber; i++)
+	{
+		size_t* slot = _findKeySlot(slots, mask, keys, _keyLengths, keys[i], _keyLengths[i]);
+		if (*slot != 0)	// only the first occurrence is resolved
+			continue;
+		*slot = i + 1;
+		_dumpOption(w, first, _keys[i], _values[i], "argv");
+	}
+
+	// the schema names are already in the spelling of the keys
+	for (size_t i = 0; i < _shortNameNumber; i++)
+	{
+		size_t k1 = *_findKeySlot(slots, mask, keys, _keyLengths, _shortNames[i], _shortNameLengths[i]);
+		size_t k2 = *_findKeySlot(slots, mask, keys, _keyLengths, _shortNameValues[i], _shortNameValueLengths[i]);
+		if (k1 == 0 && k2 != 0)
+			_dumpOption(w, first, _shortNames[i], _values[k2 - 1], "alias");
+		else if (k2 == 0 && k1 != 0)
+			_dumpOption(w, first, _shortNameValues[i], _values[k1 - 1], "alias");
+	}
+
+	for (size_t i = 0; i < _defaultNumber; i++)
+	{
+		const char* key = _defaultKeys[i];
+		size_t keyLength = _defaultKeyLengths[i];
+		if (_getDefault(key, keyLength) != _defaultValues[i] || *_findKeySlot(slots, mask, keys, _keyLengths, key, keyLength) != 0)
+			continue;
+
+		size_t aliaseLength = 0;
+		const char* aliaseName = _getAliaseName(key, keyLength, &aliaseLength);
+		if (aliaseName != NULL && *_findKeySlot(slots, mask, keys, _keyLengths, aliaseName, aliaseLength) != 0)
+			continue;
+
+		_dumpOption(w, first, key, _defaultValues[i], "default");
+	}
+
+	w.append("],\"positionals\":[");
+	for (size_t i = 0; i < _freeOptionNumber; i++)
+	{
+		if (i != 0)
+			w.append(",");
+		w.appendJsonString(_freeOptions[i]);
+	}
+
+	w.append("],\"subcommand\":");
+	if (_subcommand != NULL)
+		w.appendJsonString(_subcommand);
+	else
+		w.append("null");
+
+	w.append(",\"unknowns\":[");
+	first = true;
+	for (size_t i = 0; i < _keyValueNumber; i++)
+	{
+		if (_isUsed(i))
+			continue;
+		if (!first)
+			w.append(",");
+		first = false;
+		w.appendJsonString(_keys[i]);
+	}
+	w.append("]}");
+
+	return w.length;
+}
+
+NC_ARGPARSE_INLINE void ArgParser::setDiagnosticSink(DiagnosticSink* sink)
 {
-	const char* p = strstr(commaSplittedCommands, subcommand);
-	char nextChar;
-	return p != NULL
-		&& (p == commaSplittedCommands || *(p - 1) == ',' || *(p - 1) == ' ')
-		&& ((nextChar = *(p + strlen(subcommand))) == ',' || nextChar == ' ' || nextChar == '\0');
+	_sink = sink != NULL ? sink : StdioDiagnosticSink::instance();
 }
 
-const char* ArgParser::getSubcommand(const char* commaSplittedCommands) 
+NC_ARGPARSE_INLINE const char* ArgParser::getSubcommand(const char* commaSplittedCommands) 
 {
+	ArgProfileScope profile("getSubcommand");
+
 	// parse sub-command
+	{
+		ArgProfileScope tokenizeProfile("getSubcommand.tokenize");
+		_tokenizeAll();
+	}
+	ArgProfileScope matchProfile("getSubcommand.match");
 	if (!_subcommandParsed && _freeOptionNumber > 0)
 	{
 		_subcommand = _freeOptions[0];
 		_freeOptionNumber--;
 		memmove(_freeOptions, _freeOptions + 1, sizeof(_freeOptions[0]) * _freeOptionNumber);
+		memmove(_wideFreeOptions, _wideFreeOptions + 1, sizeof(_wideFreeOptions[0]) * _freeOptionNumber);
 
 		_subcommandParsed = true;
 	}
@@ -230,21 +1723,21 @@ const char* ArgParser::getSubcommand(const char* commaSplittedCommands)
 	if (_subcommand == NULL)
 	{
 		if (!hasArg("h", "help") && !hasArg("v", "version") && !hasArg("changelog"))
-			printf("error: No subcommand is given. \n");
+			_sink->report(ArgError_noSubcommand, NULL, "No subcommand is given.");
 		return NULL;
 	}
 
-	if (_isSubcommand(commaSplittedCommands, _subcommand))
+	if (_isSubcommand(commaSplittedCommands, _subcommand, strlen(_subcommand)))
 	{
 		if (strcmp(_subcommand, "help") == 0)
 		{
 			if (getPositionalArgNumber() != 1)
 			{
-				printf("error: Syntax error. Please use \"help SUBCMD\"\n");
+				_sink->report(ArgError_syntaxError, NULL, "Syntax error. Please use \"help SUBCMD\"");
 			}
-			else if (!_isSubcommand(commaSplittedCommands, getPositionalArgByIndex(0)))
+			else if (!_isSubcommand(commaSplittedCommands, getPositionalArgByIndex(0), strlen(getPositionalArgByIndex(0))))
 			{
-				printf("error: Unknown subcommand: %s\n", getPositionalArgByIndex(0));
+				_sink->report(ArgError_unknownSubcommand, getPositionalArgByIndex(0), "Unknown subcommand");
 				return NULL;
 			}
 		}
@@ -252,8 +1745,9 @@ const char* ArgParser::getSubcommand(const char* commaSplittedCommands)
 	}
 	else
 	{
-		printf("error: Unknown subcommand: %s\n", _subcommand);
+		_sink->report(ArgError_unknownSubcommand, _subcommand, "Unknown subcommand");
 		return NULL;
 	}
 }
 
+#endif // NC_ARGPARSE_IMPLEMENTATION
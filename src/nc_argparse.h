@@ -24,8 +24,12 @@ SOFTWARE.
 #pragma once
 
 #include "nc_types.h"
+#include "nc_profiler.h"
 
 /*
+Define NC_ARGPARSE_HEADER_ONLY to use the parser without linking nc_argparse.cpp.
+The implementation is then inline, so the small queries like hasArg() fold into the callers.
+
 A simple example Code:
 
 struct Options
@@ -34,36 +38,32 @@ struct Options
 	size_t version;
 };
 
-int _tmain(int argc, char* argv[])
+int main(int argc, char* argv[])	// UTF-8 arguments
 {
 	Options options;
 
 	ArgParser parser;
 	parser.parse(argc, argv);
 
-	if (parser.hasArg(L"version"))
+	if (parser.hasArg("version"))
 	{
 		cout << "2.0" << endl;
 		return 0;
 	}
 	
-	if (parser.hasArg(L"h", L"help"))
+	if (parser.hasArg("h", "help"))
 	{
 		return printHelp();
 	}
 
-	parser.setDefault(L"outputVersion", L"2");	// default to 2.0
-	parser.bindAliaseName(L"outputVersion", L"o");
+	parser.setDefault("outputVersion", "2");	// default to 2.0
+	parser.bindAliaseName("outputVersion", "o");
 
-	if (parser.argEquals(L"o", L"1"))
-		options.version = 0x00010000;
-	else if (parser.argEquals(L"o", L"2"))
-		options.version = 0x00020000;
-	else
-	{
-		cerr << "Unknown version number" << endl;
-		return 1;
-	}
+	static const ArgChoice versions[] = { { "1", 0x00010000 }, { "2", 0x00020000 } };
+	parser.bindChoices("o", versions);
+	options.version = parser.getChoice("o", 0);
+	if (options.version == 0)
+		return 1;	// the valid versions are reported
 
 	if (parser.getPositionalArgNumber() < 1)
 	{
@@ -76,17 +76,290 @@ int _tmain(int argc, char* argv[])
 		return 1;
 	}
 
-	options.packetName = parser.getPositionalArgByIndex(0);
+	options.packetName = parser.getPositionalArgByIndexW(0);
 }
 
 */
 
-class ArgParser
+enum ArgError
+{
+	ArgError_none = 0,
+	ArgError_unknownArgument,
+	ArgError_noSubcommand,
+	ArgError_unknownSubcommand,
+	ArgError_syntaxError,
+	ArgError_ambiguousArgument,
+	ArgError_outOfMemory,
+	ArgError_missingArgument,
+	ArgError_invalidValue,
+	ArgError_conflictingArguments,
+	ArgError_missingDependency,
+	ArgError_invalidEncoding
+};
+
+// Where the value of a key comes from.
+enum ArgSource
+{
+	ArgSource_none,
+	ArgSource_argv,
+	ArgSource_alias,
+	ArgSource_default
+};
+
+struct ArgDiagnostic
+{
+	ArgError code;
+	const char* key;	// may be NULL
+	const char* message;
+};
+
+/*
+	Receives the errors found by ArgParser. The default sink prints them immediately,
+	use BufferedDiagnosticSink to collect them and format them later in one go.
+	The key and the message are only valid during report(), a sink that keeps them copies them.
+*/
+class DiagnosticSink
+{
+public:
+	virtual ~DiagnosticSink() {}
+	virtual void report(ArgError code, const char* key, const char* message) = 0;
+};
+
+class StdioDiagnosticSink : public DiagnosticSink
+{
+public:
+	virtual void report(ArgError code, const char* key, const char* message) override;
+
+	static StdioDiagnosticSink* instance();
+};
+
+class BufferedDiagnosticSink : public DiagnosticSink
+{
+public:
+	BufferedDiagnosticSink();
+
+	virtual void report(ArgError code, const char* key, const char* message) override;
+
+	forceinline size_t getDiagnosticNumber() { return _diagnosticNumber; }
+	forceinline const ArgDiagnostic& getDiagnosticByIndex(size_t i) { return _diagnostics[i]; }
+	forceinline size_t getDroppedNumber() { return _droppedNumber; }	// no room for the diagnostic or its text
+	void clear();
+
+	/*
+		Both functions behave like snprintf: the output is always NUL terminated
+		and the returned value is the length needed to hold the full text.
+	*/
+	size_t formatText(char* buffer, size_t bufferSize);
+	size_t formatJson(char* buffer, size_t bufferSize);
+
+private:
+	size_t _diagnosticNumber;
+	size_t _droppedNumber;
+	ArgDiagnostic _diagnostics[100];
+	size_t _textLength;
+	char _text[16384];	// the copies of the keys and the messages
+};
+
+/*
+	All the memory of a parser comes from an ArgAllocator. The default one uses malloc().
+*/
+class ArgAllocator
+{
+public:
+	virtual ~ArgAllocator() {}
+	virtual void* allocate(size_t size) = 0;
+	virtual void deallocate(void* p, size_t size) = 0;
+
+	static ArgAllocator* defaultAllocator();
+};
+
+/*
+	Counters to check that argument handling stays allocation-free and cheap.
+	Only maintained when NC_ARGPARSE_STATS is 1, which is the default of debug builds.
+*/
+struct ArgParserStats
+{
+	size_t allocations;
+	size_t allocatedBytes;
+	size_t lookups;
+	size_t cacheHits;
+	size_t hashCollisions;	// the cache slot held another key
+	size_t defaultHits;		// the value came from setDefault()
+};
+
+#if NC_ARGPARSE_STATS
+#	define NC_ARGPARSE_COUNT(statement) statement
+#else
+#	define NC_ARGPARSE_COUNT(statement)
+#endif
+
+// Routes the allocations of a parser to its allocator and counts them.
+class ArgMemory
+{
+public:
+	ArgMemory(ArgAllocator* allocator);
+
+	void* allocate(size_t size);
+	void deallocate(void* p, size_t size);
+	forceinline ArgAllocator* allocator() { return _allocator; }
+
+	ArgParserStats stats;
+
+private:
+	ArgAllocator* _allocator;
+};
+
+/*
+	Bump allocator for the values the parser has to build, e.g. the arrays returned by getAll().
+	clear() merges the blocks into one of their total size, so a parser that is reused doesn't allocate again.
+*/
+class ArgArena
+{
+public:
+	ArgArena(ArgMemory* memory);
+	~ArgArena();
+
+	void* allocate(size_t size);
+	void clear();
+
+private:
+	struct Block
+	{
+		Block* next;
+		size_t size;
+		size_t used;
+	};
+	ArgMemory* _memory;
+	Block* _blocks;	// the newest first
+
+	void _freeBlocks();
+	bool _addBlock(size_t blockSize);
+
+	ArgArena(const ArgArena&);
+	ArgArena& operator=(const ArgArena&);
+};
+
+typedef uint32_t ArgStringId;	// 0 is no string
+
+/*
+	Interns strings: equal texts get the same id and share one copy, e.g. the option names
+	and the values repeated on millions of lines of a batch. Give it to the parsers with
+	ArgParser::setStringPool(). The strings live as long as the pool. Not thread-safe.
+*/
+class ArgStringPool
 {
 public:
-	ArgParser();
+	// allocator NULL means ArgAllocator::defaultAllocator()
+	ArgStringPool(ArgAllocator* allocator = NULL);
+	~ArgStringPool();
+
+	// Returns 0 if out of memory.
+	ArgStringId intern(const char* text, size_t length);
+	forceinline ArgStringId intern(const char* text) { return intern(text, strlen(text)); }
+	// Returns 0 if the text was never interned.
+	ArgStringId find(const char* text, size_t length);
+
+	forceinline const char* string(ArgStringId id) { return _strings[id - 1]; }
+	forceinline size_t length(ArgStringId id) { return _lengths[id - 1]; }
+	forceinline size_t size() { return _number; }
+	forceinline const ArgParserStats& stats() { return _memory.stats; }
+
+private:
+	ArgMemory _memory;
+	ArgArena _texts;
+
+	size_t _number;
+	size_t _capacity;
+	const char** _strings;	// by id - 1
+	uint32_t* _lengths;
+	uint32_t* _hashes;
+
+	// open addressing with linear probing, at most half full
+	size_t _slotNumber;
+	ArgStringId* _slots;
+
+	bool _grow();
+	ArgStringId* _findSlot(const char* text, size_t length, uint32_t hash);
+
+	ArgStringPool(const ArgStringPool&);
+	ArgStringPool& operator=(const ArgStringPool&);
+};
+
+// One allowed value of a choice option and its code, e.g. { "fast", Mode_fast }.
+struct ArgChoice
+{
+	const char* name;
+	int value;
+
+	template <typename E>
+	ArgChoice(const char* name_, E value_) : name(name_), value((int)value_) {}
+};
+
+// A contiguous run of values. Valid until the next parse().
+struct ArgValues
+{
+	const char* const* values;
+	size_t number;
 
+	forceinline const char* const* begin() const { return values; }
+	forceinline const char* const* end() const { return values + number; }
+	forceinline size_t size() const { return number; }
+	forceinline const char* operator[](size_t i) const { return values[i]; }
+};
+
+/*
+	Syntax policies of ArgParser::parse<Syntax>(), chosen at compile time. A policy provides:
+
+		enum { caseInsensitive = true/false, valueNumber = N };	// N: the entries a key takes as values, unless setValueNumber() says otherwise
+		static size_t switchPrefix(const char* arg);	// length of the prefix of a key, 0 for a positional argument
+		static bool isValueSeparator(char c);			// between a key and its inline value
+*/
+
+// The syntax of parse(): "--key value" and "-k value".
+struct PosixArgSyntax
+{
+	enum { caseInsensitive = false, valueNumber = 1 };
+	static forceinline size_t switchPrefix(const char* arg) { return arg[0] != '-' ? 0 : arg[1] == '-' ? 2 : 1; }
+	static forceinline bool isValueSeparator(char) { return false; }
+};
+
+// The tools of Windows: "/out:file", "/out=file", "-out:file" and "/verbose", the keys in any case.
+// A value is given inline unless setValueNumber() says otherwise, so "/verbose a.obj" has a positional argument.
+struct WindowsArgSyntax
+{
+	enum { caseInsensitive = true, valueNumber = 0 };
+	static forceinline size_t switchPrefix(const char* arg) { return (arg[0] == '/' || arg[0] == '-') && arg[1] != '\0' ? 1 : 0; }
+	static forceinline bool isValueSeparator(char c) { return c == ':' || c == '='; }
+};
+
+class ArgParser
+{
+public:
+	// allocator NULL means ArgAllocator::defaultAllocator()
+	ArgParser(ArgAllocator* allocator = NULL);
+	~ArgParser();
+
+	/*
+		The parser holds a schema (aliases, defaults, options, the diagnostic sink) and the
+		state of one invocation. parse() starts a new invocation and keeps the schema,
+		so a parser can be pooled and reused.
+	*/
 	void parse(int argc, char* argv[]);
+	/*
+		Like parse(), but the entries of argv before firstChangedArg must be the strings
+		(same addresses) given to the previous parse(). The arguments taken from them are kept,
+		only the rest is tokenized again. Used by ArgLineParser for every edit of a line.
+	*/
+	void reparse(int argc, char* argv[], int firstChangedArg);
+	/*
+		Parses with another syntax, see PosixArgSyntax. A case-insensitive syntax
+		folds the keys for this invocation only. reparse() keeps the syntax of the last parse
+		and tokenizes again from the start, parseScope() takes the syntax of the parent.
+	*/
+	template <typename Syntax>
+	void parse(int argc, char* argv[]);
+	// Forgets the current invocation in constant time.
+	void reset();
 	int argc() { return m_argc; }
 	char** argv() { return m_argv; }
 
@@ -96,6 +369,55 @@ public:
 	bool hasArg(const char* key1, const char* key2);
 	bool argEquals(const char* key, const char* value);
 
+	/*
+		Interning: the keys and all their values are added to the pool as they are tokenized,
+		and point into it, so they outlive argv. Taken by the next parse(), NULL turns it off.
+		getArgId() is the id of the value, 0 if there's none or the invocation had no pool;
+		argIdEquals() is then an integer compare.
+	*/
+	void setStringPool(ArgStringPool* pool);
+	forceinline ArgStringPool* stringPool() { return _pool; }
+	ArgStringId getArgId(const char* key);
+	forceinline bool argIdEquals(const char* key, ArgStringId valueId) { return valueId != 0 && getArgId(key) == valueId; }
+
+#if NC_ARGPARSE_HAS_STRING_VIEW
+	// The keys don't need to be NUL terminated, e.g. tokens of a mapped file.
+	forceinline const char* getArg(std::string_view key) { return _getArg(key.data(), key.size()); }
+	forceinline const char* getArg(std::string_view key1, std::string_view key2) { const char* v = getArg(key1); return v != NULL ? v : getArg(key2); }
+	forceinline bool hasArg(std::string_view key) { return getArg(key) != NULL; }
+	forceinline bool hasArg(std::string_view key1, std::string_view key2) { return hasArg(key1) || hasArg(key2); }
+	forceinline bool argEquals(std::string_view key, std::string_view value) { return _argEquals(key.data(), key.size(), value.data(), value.size()); }
+	forceinline ArgValues getAll(std::string_view key, char separator = '\0') { return _getAll(key.data(), key.size(), separator); }
+#endif
+
+	/*
+		All the values of a repeated or multi-value option, in the order they appear,
+		including those given with the alias name. Falls back to the default value.
+		With a separator, "--include a,b" is split into "a" and "b".
+	*/
+	ArgValues getAll(const char* key, char separator = '\0');
+
+	/*
+		Lets "--point 1 2 3" take up to "number" values instead of one.
+		Must be called before parse().
+	*/
+	void setValueNumber(const char* key, size_t number);
+
+	// Doesn't mark the argument as used.
+	ArgSource getArgSource(const char* key);
+
+	/*
+		Choice options. The value is resolved to its code once per invocation: by parse()
+		if the choices are bound before it, otherwise by bindChoices(). Set the default first.
+		An invalid value is reported with the allowed ones, getChoice() then returns missingValue.
+	*/
+	void bindChoices(const char* key, const ArgChoice* choices, size_t choiceNumber);
+	template <size_t N>
+	forceinline void bindChoices(const char* key, const ArgChoice (&choices)[N]) { bindChoices(key, choices, N); }
+	int getChoice(const char* key, int missingValue = -1);
+	template <typename E>
+	forceinline E getChoice(const char* key, E missingValue) { return (E)getChoice(key, (int)missingValue); }
+
 	// alias name
 	void bindAliaseName(const char* name1, const char* name2);
 	const char* getAliaseName(const char* key);
@@ -103,10 +425,46 @@ public:
 	// default value
 	void setDefault(const char* key, const char* v);
 	const char* getDefault(const char* key);
+
+	/*
+		Prefix matching, e.g. "--inter" for "--interactive". Only applies to "--" arguments and
+		only to the known names: those given to addOption(), bindAliaseName() and setDefault().
+		Register all of them before querying. An ambiguous prefix is reported and left unknown.
+	*/
+	void setPrefixMatching(bool enabled);
+	void addOption(const char* name);
+
+	/*
+		Case-insensitive keys: "--Output" is found by getArg("output"). The keys of argv are folded
+		once as they are tokenized and the names of the schema as they are given, so a lookup only
+		folds the key it's asked for. ASCII letters are folded, the rest of UTF-8 is compared as is.
+		The schema keeps both spellings of its names, so the setting can be changed at any time.
+	*/
+	void setCaseInsensitiveKeys(bool enabled);
+
+	// Reports ArgError_invalidEncoding for every argv entry that isn't valid UTF-8, as it's tokenized.
+	void setUtf8Validation(bool enabled);
+	static bool isValidUtf8(const char* text, size_t length);
+
+	/*
+		A wchar_t view of a value (UTF-16 on Windows, UTF-32 elsewhere), e.g. for the file API
+		of Windows. Converted on the first call and cached until the next parse(),
+		an invalid UTF-8 sequence becomes U+FFFD.
+	*/
+	const wchar_t* getArgW(const char* key);
+	const wchar_t* getPositionalArgByIndexW(size_t i);
+
+	/*
+		Lazy parsing: parse() only records argv and a query tokenizes it up to the first match,
+		so "--version" returns without walking the rest. The positional arguments, the unknown
+		arguments, getAll(), getSubcommand(), dumpJson() and prefix matching still scan it all.
+		An invalid choice is only reported when getChoice() is called.
+	*/
+	void setLazyParsing(bool lazy);
 	
 	// positional argument
-	forceinline size_t getPositionalArgNumber() { return _freeOptionNumber; }
-	forceinline const char* getPositionalArgByIndex(size_t i) { return _freeOptions[i]; }
+	forceinline size_t getPositionalArgNumber() { _tokenizeAll(); return _freeOptionNumber; }
+	forceinline const char* getPositionalArgByIndex(size_t i) { _tokenizeAll(); return _freeOptions[i]; }
 
 	// unknown arguments
 	bool hasUnknownArgs();
@@ -117,34 +475,337 @@ public:
 	// subcommand
 	const char* getSubcommand(const char* commaSplittedCommands);
 
+	/*
+		Scopes: in "tool --verbose compile a.c -O2", the global options come before the subcommand.
+		With setScopeCommands(), the tokenization stops at the first of the commands, which
+		getSubcommand() returns. parseScope() then parses the rest of argv in another parser.
+		A key missing in a scope is looked up in its parent through a pointer: the arguments
+		of the parent come before the defaults of the scope. The unknown arguments, getAll(),
+		getArgSource() and dumpJson() only see their own scope. Parse the scope after its parent.
+	*/
+	void setScopeCommands(const char* commaSplittedCommands);
+	void parseScope(ArgParser* parent);
+	forceinline ArgParser* parent() { return _parent; }
+
+	/*
+		Writes the resolved state as JSON: every option with the layer that supplied
+		its value ("argv", "alias" or "default"), the positional arguments, the subcommand
+		and the unknown arguments. Doesn't mark any argument as used.
+		Behaves like snprintf, returns the length needed to hold the full text.
+	*/
+	size_t dumpJson(char* buffer, size_t bufferSize);
+
+	forceinline const ArgParserStats& stats() { return _memory.stats; }
+	forceinline ArgAllocator* allocator() { return _memory.allocator(); }
+
+	// diagnostics. NULL restores the default stdio sink.
+	void setDiagnosticSink(DiagnosticSink* sink);
+	forceinline DiagnosticSink* diagnosticSink() { return _sink; }
+
 private:
-	int m_argc;
-	char** m_argv;
+	/*
+		Parallel arrays carved from one allocation, e.g. the keys and the values of the arguments.
+		Grown with _reserve(), which keeps the first "number" rows and takes the arrays
+		from the biggest alignment down.
+	*/
+	struct Columns
+	{
+		void* block;
+		size_t blockSize;
+		size_t capacity;
+	};
 
-	size_t _keyValueNumber;
-	char* _keys[100];
-	const char* _values[100];
-	bool _keyUsed[100];
+	ArgMemory _memory;
+
+	// schema: survives reset()
+	DiagnosticSink* _sink;
+
+	size_t _valueNumberNumber;
+	Columns _valueNumberColumns;
+	const char** _valueNumberKeys;
+	const char** _otherValueNumberKeys;	// folded if the names aren't, see _setCaseInsensitive()
+	size_t* _valueNumbers;
 
 	size_t _defaultNumber;
-	const char* _defaultKeys[100];
-	const char* _defaultValues[100];
+	Columns _defaultColumns;
+	const char** _defaultKeys;
+	const char** _otherDefaultKeys;
+	const char** _defaultValues;
+	const wchar_t** _defaultWideValues;	// valid while the stamp equals _generation
+	size_t* _defaultKeyLengths;
+	uint32_t* _defaultWideStamps;
 
 	size_t _shortNameNumber;
-	const char* _shortNames[100];
-	const char* _shortNameValues[100];
+	Columns _shortNameColumns;
+	const char** _shortNames;
+	const char** _shortNameValues;
+	const char** _otherShortNames;
+	const char** _otherShortNameValues;
+	size_t* _shortNameLengths;
+	size_t* _shortNameValueLengths;
+
+	bool _prefixMatching;
+	bool _lazyParsing;
+	bool _caseInsensitive;		// of this invocation
+	bool _caseInsensitiveKeys;	// setCaseInsensitiveKeys()
+	bool _validateUtf8;
+	ArgArena _schemaArena;	// the folded names of the schema
+	ArgStringPool* _pool;
+	const char* _scopeCommands;
+	size_t _optionNameNumber;
+	Columns _optionNameColumns;
+	const char** _optionNames;
+	const char** _otherOptionNames;
+	size_t _sortedNameNumber;
+	Columns _sortedNameColumns;
+	const char** _sortedNames;	// _optionNames + aliases + default keys, sorted and unique
+
+	size_t _choiceOptionNumber;
+	Columns _choiceOptionColumns;
+	const char** _choiceKeys;
+	const char** _otherChoiceKeys;
+	const ArgChoice** _choiceTables;
+	size_t* _choiceNumbers;
+	int* _choiceCodes;		// valid while the stamp equals _generation
+	uint32_t* _choiceStamps;
+
+	// per invocation: cleared by reset()
+	int m_argc;
+	char** m_argv;
+	int _nextArgIndex;	// the first argv entry not tokenized yet
+	typedef void (ArgParser::*Tokenizer)();
+	Tokenizer _tokenizer;	// lazy parsing and reparse() under another syntax than POSIX, NULL for POSIX
+	bool _syntaxCaseInsensitive;
+
+	uint32_t _generation;	// a key is used if its stamp equals the generation
+	size_t _keyValueNumber;
+	Columns _keyColumns;
+	const char** _keys;
+	const char** _foldedKeys;	// the index of case-insensitive keys, same lengths as _keys
+	const char** _values;
+	const char*** _moreValues;	// the interned values after the first, NULL without a string pool
+	const wchar_t** _wideValues;	// NULL until getArgW()
+	size_t* _keyLengths;
+	size_t* _keyValueCount;	// number of argv entries taken as values
+	uint32_t* _keyUsedStamps;
+	ArgStringId* _valueIds;	// with _argPool
+	ArgStringPool* _argPool;	// the string pool of this invocation
+	int* _keyArgIndex;	// index in argv
+	bool* _keyAmbiguous;
 
 	size_t _freeOptionNumber;
-	char* _freeOptions[100];
+	Columns _freeOptionColumns;
+	char** _freeOptions;
+	const wchar_t** _wideFreeOptions;
 
 	size_t _unknownArgIter;
 
 	bool _subcommandParsed;
 	const char* _subcommand;
-
-	const char* _getArgWithAliase(const char* key, bool useAliase);
+	int _subcommandArgc;	// of the scope that starts at the subcommand, 0 if there's none
+	ArgParser* _parent;
+
+	bool _prefixIndexDirty;
+
+	ArgArena _arena;
+	bool _outOfMemoryReported;
+
+	/*
+		Remembers where a key was resolved (an argument, a default, or nowhere).
+		Any change of the schema or of the invocation bumps _cacheGeneration.
+		A scope also drops its cache when the generation of one of its parents changes.
+	*/
+	enum { LOOKUP_CACHE_SIZE = 16 };
+	static const size_t NO_KEY = (size_t)-1;
+	static const size_t OUTER_KEY = (size_t)-2;	// given to a parent scope
+	struct LookupCacheEntry
+	{
+		const char* key;
+		size_t keyLength;
+		uint32_t hash;
+		uint32_t generation;
+		const char* value;
+		size_t keyIndex;	// the argument to mark as used, or NO_KEY or OUTER_KEY
+	};
+	uint32_t _cacheGeneration;
+	uint32_t _parentCacheGeneration;	// of the parent chain when the cache was filled
+	LookupCacheEntry _lookupCache[LOOKUP_CACHE_SIZE];
+
+	template <typename... T>
+	bool _reserve(Columns& columns, size_t number, size_t neededNumber, T*&... arrays);
+	void _release(Columns& columns);
+	bool _reserveKeys();
+	void _reportOutOfMemory();
+	bool _reserveFreeOptions();
+	void _setCaseInsensitive(bool enabled);
+	void _setSchemaName(const char*& name, const char*& otherName, const char* newName, size_t length);
+	const char* _foldName(const char* name, size_t length, ArgArena& arena);
+	const char* _foldInto(const char* key, size_t keyLength, char (&buffer)[64]);
+	forceinline const char* _foldQuery(const char* key, size_t keyLength, char (&buffer)[64]) { return _caseInsensitive ? _foldInto(key, keyLength, buffer) : key; }
+	const wchar_t* _toWide(const char* text);
+	const wchar_t* _getDefaultWide(const char* value);
+	void _checkUtf8(const char* arg);
+	void _internArg(size_t keyIndex);
+	void _internMoreValues(size_t keyIndex);
+	void _resolveChoice(size_t i);
+	void _parse(int argc, char* argv[]);
+	void _startTokenizing();
+	void _tokenizeRest();
+	void _resolveChoices();
+	template <typename Syntax>
+	static forceinline Tokenizer _tokenizerOf() { return &ArgParser::_tokenizeNextWith<Syntax>; }
+	template <typename Syntax>
+	forceinline void _tokenizeAllWith() { while (_nextArgIndex < m_argc) _tokenizeNextWith<Syntax>(); }
+	template <typename Syntax>
+	void _tokenizeNextWith();
+	void _tokenizeNext();
+	bool _isScopeCommand(const char* arg);
+	forceinline void _tokenizeAll() { if (_nextArgIndex < m_argc) _tokenizeRest(); }
+
+	const char* _getArg(const char* key, size_t keyLength, size_t* keyIndex);
+	forceinline const char* _getArg(const char* key, size_t keyLength) { size_t keyIndex; return _getArg(key, keyLength, &keyIndex); }
+	const char* _getArgWithParent(const char* key, size_t keyLength, size_t* keyIndex);
+	const char* _getArgWithAliase(const char* key, size_t keyLength, bool useAliase, size_t* keyIndex);
+	void _invalidateCache();
+	uint32_t _parentChainGeneration();
+	bool _argEquals(const char* key, size_t keyLength, const char* value, size_t valueLength);
+	ArgValues _getAll(const char* key, size_t keyLength, char separator);
+	const char* _getAliaseName(const char* key, size_t keyLength, size_t* aliaseLength);
+	const char* _getDefault(const char* key, size_t keyLength);
+	size_t _findKey(const char* key, size_t keyLength);
+	size_t _getValueNumber(const char* key, size_t keyLength, size_t defaultNumber);
+	forceinline const char* _valueOf(size_t keyIndex, size_t i) { return i == 0 ? _values[keyIndex] : _moreValues[keyIndex] != NULL ? _moreValues[keyIndex][i - 1] : m_argv[_keyArgIndex[keyIndex] + 1 + i]; }
+	forceinline void _resolvePrefixes() { if (_prefixIndexDirty) _rebuildPrefixIndex(); }
+	forceinline void _markUsed(size_t keyIndex) { _keyUsedStamps[keyIndex] = _generation; }
+	forceinline bool _isUsed(size_t keyIndex) { return _keyUsedStamps[keyIndex] == _generation; }
+	void _rebuildPrefixIndex();
 };
 
+// the default syntax is tokenized by direct calls
+template <>
+forceinline ArgParser::Tokenizer ArgParser::_tokenizerOf<PosixArgSyntax>()
+{
+	return NULL;
+}
+
+template <typename Syntax>
+inline void ArgParser::parse(int argc, char* argv[])
+{
+	ArgProfileScope profile("parse");
+	_tokenizer = _tokenizerOf<Syntax>();
+	_syntaxCaseInsensitive = Syntax::caseInsensitive;
+	_parse(argc, argv);
+
+	// lazy: the queries tokenize what they need, the choices are resolved by getChoice()
+	if (_lazyParsing)
+		return;
+	_tokenizeAllWith<Syntax>();
+	_resolveChoices();
+}
+
+template <typename Syntax>
+inline void ArgParser::_tokenizeNextWith()
+{
+	char** argv = m_argv;
+	int argc = m_argc;
+	int i = _nextArgIndex;
+
+	size_t prefixLength = Syntax::switchPrefix(argv[i]);
+	if (prefixLength != 0)
+	{
+		if (!_reserveKeys())
+		{
+			_nextArgIndex = argc;
+			return;
+		}
+
+		if (_validateUtf8)
+			_checkUtf8(argv[i]);
+
+		// --version, -v or /out:file
+		const char* key = argv[i] + prefixLength;
+		const char* separator = key;
+		while (*separator != '\0' && !Syntax::isValueSeparator(*separator))
+			separator++;
+		size_t keyLength = (size_t)(separator - key);
+		if (*separator != '\0')
+		{
+			// the key is copied to end it with a NUL, the inline value already ends the entry
+			char* keyCopy = (char*)_arena.allocate(keyLength + 1);
+			if (keyCopy == NULL)
+			{
+				_reportOutOfMemory();
+				_nextArgIndex = argc;
+				return;
+			}
+			memcpy(keyCopy, key, keyLength);
+			keyCopy[keyLength] = '\0';
+			key = keyCopy;
+		}
+		_keys[_keyValueNumber] = key;
+		_keyLengths[_keyValueNumber] = keyLength;
+		_keyArgIndex[_keyValueNumber] = i;
+		_wideValues[_keyValueNumber] = NULL;
+		if (_caseInsensitive)
+		{
+			key = _foldName(key, keyLength, _arena);
+			_foldedKeys[_keyValueNumber] = key;
+		}
+
+		size_t count = 0;
+		if (*separator != '\0')
+			_values[_keyValueNumber] = separator + 1;	// no argv entry is taken as the value
+		else
+		{
+			size_t valueNumber = _valueNumberNumber != 0 ? _getValueNumber(key, keyLength, Syntax::valueNumber) : (size_t)Syntax::valueNumber;
+			while (count < valueNumber && i + 1 < argc && Syntax::switchPrefix(argv[i + 1]) == 0 && !_isScopeCommand(argv[i + 1]))
+			{
+				if (count == 0)
+					_values[_keyValueNumber] = argv[i + 1];
+				count++;
+				i++;
+				if (_validateUtf8)
+					_checkUtf8(argv[i]);
+			}
+			if (count == 0)
+				_values[_keyValueNumber] = "";
+		}
+		_keyValueCount[_keyValueNumber] = count;
+
+		_keyUsedStamps[_keyValueNumber] = 0;
+		_keyAmbiguous[_keyValueNumber] = false;
+		_moreValues[_keyValueNumber] = NULL;
+		if (_argPool != NULL)
+			_internArg(_keyValueNumber);
+
+		_keyValueNumber++;
+	}
+	else if (_isScopeCommand(argv[i]))
+	{
+		// the rest of argv belongs to the scope of the subcommand, see parseScope()
+		_subcommand = argv[i];
+		_subcommandParsed = true;
+		_subcommandArgc = argc - i;
+		m_argc = i;
+		_nextArgIndex = i;
+		return;
+	}
+	else
+	{
+		if (!_reserveFreeOptions())
+		{
+			_nextArgIndex = argc;
+			return;
+		}
+		if (_validateUtf8)
+			_checkUtf8(argv[i]);
+		_wideFreeOptions[_freeOptionNumber] = NULL;
+		_freeOptions[_freeOptionNumber++] = argv[i];
+	}
+
+	_nextArgIndex = i + 1;
+}
+
 class Subcommand
 {
 public:
@@ -156,3 +817,7 @@ public:
 	virtual bool parseArguments(ArgParser& parse) = 0;
 	virtual int run() = 0;
 };
+
+#if defined(NC_ARGPARSE_HEADER_ONLY)
+#	include "nc_argparse.cpp"
+#endif
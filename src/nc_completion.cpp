@@ -0,0 +1,234 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_completion.h"
+#include "nc_text_writer.h"
+
+/*
+	Entries are kept sorted by (scope, word), so all the words starting with a prefix
+	are one contiguous range found by binary search.
+*/
+static int _compare(const char* a, size_t aLength, const char* b, size_t bLength)
+{
+	int r = memcmp(a, b, aLength < bLength ? aLength : bLength);
+	if (r != 0)
+		return r;
+	return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+ArgCompleter::ArgCompleter()
+{
+	_subcommandNumber = 0;
+	_optionNumber = 0;
+}
+
+void ArgCompleter::_add(Entry* entries, size_t& number, size_t capacity, const char* scope, size_t scopeLength, const char* commaSplittedWords)
+{
+	const char* p = commaSplittedWords;
+	while (*p != '\0')
+	{
+		while (*p == ',' || *p == ' ')
+			p++;
+		const char* word = p;
+		while (*p != '\0' && *p != ',' && *p != ' ')
+			p++;
+		if (p == word || number == capacity)
+			continue;
+
+		Entry e = { scope, scopeLength, word, (size_t)(p - word) };
+
+		// insertion sort, registration happens once with a few dozens of words.
+		size_t i = number;
+		while (i > 0)
+		{
+			const Entry& prev = entries[i - 1];
+			int r = _compare(prev.scope, prev.scopeLength, scope, scopeLength);
+			if (r < 0 || (r == 0 && _compare(prev.word, prev.wordLength, e.word, e.wordLength) <= 0))
+				break;
+			entries[i] = prev;
+			i--;
+		}
+		entries[i] = e;
+		number++;
+	}
+}
+
+void ArgCompleter::addSubcommands(const char* commaSplittedCommands)
+{
+	_add(_subcommands, _subcommandNumber, sizeof(_subcommands) / sizeof(_subcommands[0]), "", 0, commaSplittedCommands);
+}
+
+void ArgCompleter::addOptions(const char* subcommand, const char* commaSplittedOptions)
+{
+	if (subcommand == NULL)
+		subcommand = "";
+	_add(_options, _optionNumber, sizeof(_options) / sizeof(_options[0]), subcommand, strlen(subcommand), commaSplittedOptions);
+}
+
+size_t ArgCompleter::_lookup(const Entry* entries, size_t number, const char* scope, size_t scopeLength, const char* prefix, size_t prefixLength,
+	bool isOption, CompletionCandidate* candidates, size_t candidateNumber, size_t maxCandidates)
+{
+	// lower bound of (scope, prefix)
+	size_t lo = 0, hi = number;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		const Entry& e = entries[mid];
+		int r = _compare(e.scope, e.scopeLength, scope, scopeLength);
+		if (r < 0 || (r == 0 && _compare(e.word, e.wordLength, prefix, prefixLength) < 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (size_t i = lo; i < number; i++)
+	{
+		const Entry& e = entries[i];
+		if (_compare(e.scope, e.scopeLength, scope, scopeLength) != 0
+			|| e.wordLength < prefixLength || memcmp(e.word, prefix, prefixLength) != 0)
+			break;
+
+		if (candidateNumber < maxCandidates)
+		{
+			CompletionCandidate& c = candidates[candidateNumber];
+			c.text = e.word;
+			c.length = e.wordLength;
+			c.isOption = isOption;
+		}
+		candidateNumber++;
+	}
+	return candidateNumber;
+}
+
+size_t ArgCompleter::complete(int wordNumber, char* words[], CompletionCandidate* candidates, size_t maxCandidates)
+{
+	if (wordNumber < 1)
+		return 0;
+
+	const char* partial = words[wordNumber - 1];
+
+	// the subcommand is the first known subcommand among the finished words
+	const char* subcommand = NULL;
+	size_t subcommandLength = 0;
+	for (int i = 0; i < wordNumber - 1 && subcommand == NULL; i++)
+	{
+		if (words[i][0] == '-')
+			continue;
+		size_t length = strlen(words[i]);
+		CompletionCandidate c;
+		if (_lookup(_subcommands, _subcommandNumber, "", 0, words[i], length, false, &c, 0, 1) != 0 && c.length == length)
+		{
+			subcommand = words[i];
+			subcommandLength = length;
+		}
+	}
+
+	if (partial[0] == '-')
+	{
+		const char* prefix = partial[1] == '-' ? partial + 2 : partial + 1;
+		size_t prefixLength = strlen(prefix);
+		size_t n = _lookup(_options, _optionNumber, "", 0, prefix, prefixLength, true, candidates, 0, maxCandidates);
+		if (subcommand != NULL)
+			n = _lookup(_options, _optionNumber, subcommand, subcommandLength, prefix, prefixLength, true, candidates, n, maxCandidates);
+		return n;
+	}
+
+	if (subcommand == NULL)
+		return _lookup(_subcommands, _subcommandNumber, "", 0, partial, strlen(partial), false, candidates, 0, maxCandidates);
+
+	return 0;	// positional argument, let the shell complete file names
+}
+
+int ArgCompleter::printCompletions(int wordNumber, char* words[])
+{
+	CompletionCandidate candidates[300];
+	size_t n = complete(wordNumber, words, candidates, sizeof(candidates) / sizeof(candidates[0]));
+	if (n > sizeof(candidates) / sizeof(candidates[0]))
+		n = sizeof(candidates) / sizeof(candidates[0]);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const CompletionCandidate& c = candidates[i];
+		const char* dashes = !c.isOption ? "" : (c.length == 1 ? "-" : "--");
+		printf("%s%.*s\n", dashes, (int)c.length, c.text);
+	}
+	return 0;
+}
+
+bool ArgCompleter::isCompletionRequest(int argc, char* argv[])
+{
+	return argc >= 2 && strcmp(argv[1], "__complete") == 0;
+}
+
+bool ArgCompleter::parseShellName(const char* name, CompletionShell* shell)
+{
+	if (strcmp(name, "bash") == 0)
+		*shell = CompletionShell_bash;
+	else if (strcmp(name, "zsh") == 0)
+		*shell = CompletionShell_zsh;
+	else if (strcmp(name, "fish") == 0)
+		*shell = CompletionShell_fish;
+	else
+		return false;
+	return true;
+}
+
+size_t ArgCompleter::writeScript(CompletionShell shell, const char* appName, char* buffer, size_t bufferSize)
+{
+	// shell function names can't contain every character a file name can
+	char functionName[64];
+	size_t n = 0;
+	for (const char* p = appName; *p != '\0' && n + 1 < sizeof(functionName); p++)
+	{
+		char c = *p;
+		bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+		functionName[n++] = valid ? c : '_';
+	}
+	functionName[n] = '\0';
+
+	ArgTextWriter w(buffer, bufferSize);
+	switch (shell)
+	{
+	case CompletionShell_bash:
+		w.append("_"); w.append(functionName); w.append("_complete() {\n"
+			"    local IFS=$'\\n'\n"
+			"    COMPREPLY=($(\"${COMP_WORDS[0]}\" __complete \"${COMP_WORDS[@]:1:COMP_CWORD}\" 2>/dev/null))\n"
+			"}\n"
+			"complete -o default -F _"); w.append(functionName); w.append("_complete "); w.append(appName); w.append("\n");
+		break;
+	case CompletionShell_zsh:
+		w.append("#compdef "); w.append(appName); w.append("\n"
+			"_"); w.append(functionName); w.append("() {\n"
+			"    local -a candidates\n"
+			"    candidates=(\"${(@f)$(\"${words[1]}\" __complete \"${(@)words[2,CURRENT]}\" 2>/dev/null)}\")\n"
+			"    if (( ${#candidates} )); then compadd -- $candidates; else _files; fi\n"
+			"}\n"
+			"compdef _"); w.append(functionName); w.append(" "); w.append(appName); w.append("\n");
+		break;
+	case CompletionShell_fish:
+		w.append("complete -c "); w.append(appName); w.append(" -a '("); w.append(appName);
+		w.append(" __complete (commandline -opc)[2..-1] (commandline -ct))'\n");
+		break;
+	}
+	return w.length;
+}
@@ -0,0 +1,101 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_types.h"
+
+/*
+Shell completion for programs built on ArgParser and Subcommand.
+
+The completion scripts call the program back as "APP __complete WORD...", where the last
+word is the one being completed. Answer that request before anything else is parsed:
+
+int main(int argc, char** argv)
+{
+	ArgCompleter completer;
+	completer.addSubcommands("compile,test");
+	completer.addOptions(NULL, "h,help");
+	completer.addOptions("compile", "mode,i,interactive");
+
+	if (ArgCompleter::isCompletionRequest(argc, argv))
+		return completer.printCompletions(argc - 2, argv + 2);
+	...
+}
+*/
+
+enum CompletionShell
+{
+	CompletionShell_bash,
+	CompletionShell_zsh,
+	CompletionShell_fish
+};
+
+struct CompletionCandidate
+{
+	const char* text;	// not NUL terminated
+	size_t length;
+	bool isOption;		// print with "-" or "--"
+};
+
+class ArgCompleter
+{
+public:
+	ArgCompleter();
+
+	void addSubcommands(const char* commaSplittedCommands);
+	// subcommand NULL means the options are available to every subcommand.
+	void addOptions(const char* subcommand, const char* commaSplittedOptions);
+
+	/*
+		words[wordNumber - 1] is the word being completed.
+		Returns the number of candidates, which may be bigger than maxCandidates.
+	*/
+	size_t complete(int wordNumber, char* words[], CompletionCandidate* candidates, size_t maxCandidates);
+	// Prints one candidate per line. Returns the process exit code.
+	int printCompletions(int wordNumber, char* words[]);
+
+	static bool isCompletionRequest(int argc, char* argv[]);
+	static bool parseShellName(const char* name, CompletionShell* shell);
+	// Behaves like snprintf, returns the length needed to hold the full script.
+	static size_t writeScript(CompletionShell shell, const char* appName, char* buffer, size_t bufferSize);
+
+private:
+	struct Entry
+	{
+		const char* scope;
+		size_t scopeLength;
+		const char* word;
+		size_t wordLength;
+	};
+
+	size_t _subcommandNumber;
+	Entry _subcommands[100];
+
+	size_t _optionNumber;
+	Entry _options[200];
+
+	void _add(Entry* entries, size_t& number, size_t capacity, const char* scope, size_t scopeLength, const char* commaSplittedWords);
+	size_t _lookup(const Entry* entries, size_t number, const char* scope, size_t scopeLength, const char* prefix, size_t prefixLength,
+		bool isOption, CompletionCandidate* candidates, size_t candidateNumber, size_t maxCandidates);
+};
@@ -0,0 +1,243 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_profiler.h"
+
+// In header-only mode this file is included by nc_profiler.h.
+#ifndef NC_PROFILER_IMPLEMENTATION
+#define NC_PROFILER_IMPLEMENTATION
+
+#include "nc_text_writer.h"
+#include <mutex>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+NC_ARGPARSE_INLINE ArgProfiler::State& ArgProfiler::_state()
+{
+	static State state;	// zero initialized, no constructor runs
+	return state;
+}
+
+NC_ARGPARSE_INLINE uint64_t ArgProfiler::now()
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart * 1000000000 + counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+#else
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+#endif
+}
+
+static void _flushProfileAtExit()
+{
+	ArgProfiler::flush();
+}
+
+NC_ARGPARSE_INLINE bool ArgProfiler::_initialize()
+{
+	// the first thread reads the environment, the others wait for it
+	static std::once_flag once;
+	std::call_once(once, []
+	{
+		const char* value = getenv("NC_ARGPARSE_PROFILE");
+		if (value != NULL && value[0] != '\0')
+			enable(value);
+		_state().initialized.store(true, std::memory_order_release);
+	});
+	return _state().format.load(std::memory_order_relaxed) != ArgProfileFormat_none;
+}
+
+NC_ARGPARSE_INLINE bool ArgProfiler::enable(const char* spec)
+{
+	// text|json[:FILE]
+	const char* colon = strchr(spec, ':');
+	size_t formatLength = colon != NULL ? (size_t)(colon - spec) : strlen(spec);
+	ArgProfileFormat format;
+	if (formatLength == 4 && strncmp(spec, "text", 4) == 0)
+		format = ArgProfileFormat_text;
+	else if (formatLength == 4 && strncmp(spec, "json", 4) == 0)
+		format = ArgProfileFormat_chromeTrace;
+	else
+		return false;
+	enable(format, colon != NULL ? colon + 1 : NULL);
+	return true;
+}
+
+NC_ARGPARSE_INLINE void ArgProfiler::enable(ArgProfileFormat format, const char* fileName)
+{
+	State& s = _state();
+	if (!s.initialized || s.format.load() == ArgProfileFormat_none)
+	{
+		if (s.origin == 0)
+			atexit(_flushProfileAtExit);
+		s.origin = now();
+	}
+	s.initialized = true;
+	s.fileName[0] = '\0';
+	if (fileName != NULL && strlen(fileName) < sizeof(s.fileName))
+		strcpy(s.fileName, fileName);
+	s.format = format;
+}
+
+NC_ARGPARSE_INLINE void ArgProfiler::disable()
+{
+	State& s = _state();
+	s.initialized = true;
+	s.format = ArgProfileFormat_none;
+}
+
+NC_ARGPARSE_INLINE uint32_t ArgProfiler::_threadIndex()
+{
+	static thread_local uint32_t index;
+	if (index == 0)
+		index = ++_state().threadNumber;
+	return index;
+}
+
+NC_ARGPARSE_INLINE void ArgProfiler::record(const char* name, uint64_t start, uint64_t end)
+{
+	State& s = _state();
+	size_t i = s.eventNumber++;
+	if (i >= MAX_EVENT_NUMBER)
+		return;
+
+	Event& e = s.events[i];
+	e.name = name;
+	e.start = start > s.origin ? start - s.origin : 0;
+	e.duration = end - start;
+	e.thread = _threadIndex();
+}
+
+NC_ARGPARSE_INLINE size_t ArgProfiler::eventNumber()
+{
+	size_t n = _state().eventNumber;
+	return n < (size_t)MAX_EVENT_NUMBER ? n : (size_t)MAX_EVENT_NUMBER;
+}
+
+NC_ARGPARSE_INLINE const ArgProfiler::Event& ArgProfiler::eventByIndex(size_t i)
+{
+	return _state().events[i];
+}
+
+NC_ARGPARSE_INLINE void ArgProfiler::clear()
+{
+	_state().eventNumber = 0;
+}
+
+NC_ARGPARSE_INLINE size_t ArgProfiler::writeText(char* buffer, size_t bufferSize)
+{
+	ArgTextWriter w(buffer, bufferSize);
+	char line[128];
+	size_t n = eventNumber();
+
+	// one line per phase, in the order they first ran
+	w.append("phase                       count    total us\n");
+	for (size_t i = 0; i < n; i++)
+	{
+		const Event& e = eventByIndex(i);
+		size_t first = 0;
+		while (strcmp(eventByIndex(first).name, e.name) != 0)
+			first++;
+		if (first != i)
+			continue;
+
+		size_t count = 0;
+		uint64_t total = 0;
+		for (size_t j = i; j < n; j++)
+		{
+			if (strcmp(eventByIndex(j).name, e.name) == 0)
+			{
+				count++;
+				total += eventByIndex(j).duration;
+			}
+		}
+		snprintf(line, sizeof(line), "%-24s %8u %11.1f\n", e.name, (unsigned)count, total / 1000.0);
+		w.append(line);
+	}
+
+	size_t recorded = _state().eventNumber;
+	if (recorded > n)
+	{
+		snprintf(line, sizeof(line), "%u events dropped\n", (unsigned)(recorded - n));
+		w.append(line);
+	}
+	return w.length;
+}
+
+NC_ARGPARSE_INLINE size_t ArgProfiler::writeChromeTrace(char* buffer, size_t bufferSize)
+{
+	ArgTextWriter w(buffer, bufferSize);
+	char numbers[128];
+	size_t n = eventNumber();
+
+	w.append("{\"traceEvents\":[");
+	for (size_t i = 0; i < n; i++)
+	{
+		const Event& e = eventByIndex(i);
+		if (i != 0)
+			w.append(",");
+		w.append("{\"name\":");
+		w.appendJsonString(e.name);
+		snprintf(numbers, sizeof(numbers), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+			e.start / 1000.0, e.duration / 1000.0, (unsigned)e.thread);
+		w.append(numbers);
+	}
+	w.append("],\"displayTimeUnit\":\"ns\"}\n");
+	return w.length;
+}
+
+NC_ARGPARSE_INLINE bool ArgProfiler::flush()
+{
+	State& s = _state();
+	int format = s.format;
+	if (format == ArgProfileFormat_none)
+		return false;
+
+	size_t length = format == ArgProfileFormat_text ? writeText(NULL, 0) : writeChromeTrace(NULL, 0);
+	char* text = (char*)malloc(length + 1);
+	if (text == NULL)
+		return false;
+	if (format == ArgProfileFormat_text)
+		writeText(text, length + 1);
+	else
+		writeChromeTrace(text, length + 1);
+
+	FILE* fp = s.fileName[0] != '\0' ? fopen(s.fileName, "w") : stderr;
+	bool written = fp != NULL && fwrite(text, 1, length, fp) == length;
+	if (fp != NULL && fp != stderr)
+		fclose(fp);
+	free(text);
+	return written;
+}
+
+#endif // NC_PROFILER_IMPLEMENTATION
@@ -0,0 +1,110 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_types.h"
+#include <atomic>
+
+enum ArgProfileFormat
+{
+	ArgProfileFormat_none,
+	ArgProfileFormat_text,			// a summary per phase
+	ArgProfileFormat_chromeTrace	// for chrome://tracing or Perfetto
+};
+
+/*
+Timestamps of the startup phases: parse(), getSubcommand(), parseArguments() and run(),
+to tell how much of a cold start goes to the arguments and how much to the command.
+Enabled by the environment, the result is written at exit:
+
+	NC_ARGPARSE_PROFILE=text ./tool compile a b				# summary on stderr
+	NC_ARGPARSE_PROFILE=json:trace.json ./tool compile a b		# Chrome trace
+
+or by enable(), e.g. from a --profile option. When it's disabled, a phase costs one load and a branch.
+The events go to a fixed buffer, so recording doesn't allocate and is safe from any thread.
+*/
+class ArgProfiler
+{
+public:
+	struct Event
+	{
+		const char* name;
+		uint64_t start;		// ns since the profiler was enabled
+		uint64_t duration;	// ns
+		uint32_t thread;	// 1 for the first thread that recorded an event
+	};
+	enum { MAX_EVENT_NUMBER = 1024 };
+
+	// fileName NULL means stderr
+	static void enable(ArgProfileFormat format, const char* fileName = NULL);
+	// The same "text|json[:FILE]" as NC_ARGPARSE_PROFILE, return false on an unknown format.
+	static bool enable(const char* spec);
+	static void disable();
+	static forceinline bool enabled() { State& s = _state(); return s.format.load(std::memory_order_relaxed) != ArgProfileFormat_none || (!s.initialized.load(std::memory_order_acquire) && _initialize()); }
+
+	// A monotonic clock in ns: clock_gettime() or QueryPerformanceCounter().
+	static uint64_t now();
+	static void record(const char* name, uint64_t start, uint64_t end);
+
+	static size_t eventNumber();
+	static const Event& eventByIndex(size_t i);
+	static void clear();
+
+	// Like snprintf, return the length needed to hold the full text.
+	static size_t writeText(char* buffer, size_t bufferSize);
+	static size_t writeChromeTrace(char* buffer, size_t bufferSize);
+	// Writes in the enabled format, done at exit.
+	static bool flush();
+
+private:
+	struct State
+	{
+		std::atomic<bool> initialized;	// the environment was read, or enable() or disable() was called
+		std::atomic<int> format;
+		char fileName[260];
+		uint64_t origin;
+		std::atomic<size_t> eventNumber;	// may go past MAX_EVENT_NUMBER, the extra events are dropped
+		std::atomic<uint32_t> threadNumber;
+		Event events[MAX_EVENT_NUMBER];
+	};
+	static State& _state();
+	static bool _initialize();
+	static uint32_t _threadIndex();
+};
+
+// Records the time between the constructor and the destructor.
+class ArgProfileScope
+{
+public:
+	forceinline ArgProfileScope(const char* name) : _name(name), _start(ArgProfiler::enabled() ? ArgProfiler::now() : 0) {}
+	forceinline ~ArgProfileScope() { if (_start != 0) ArgProfiler::record(_name, _start, ArgProfiler::now()); }
+
+private:
+	const char* _name;
+	uint64_t _start;
+};
+
+#if defined(NC_ARGPARSE_HEADER_ONLY)
+#	include "nc_profiler.cpp"
+#endif
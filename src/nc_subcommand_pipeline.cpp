@@ -0,0 +1,200 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_subcommand_pipeline.h"
+#include <memory>
+
+ArgExecutor::ArgExecutor(size_t threadNumber)
+{
+	_stopping = false;
+	if (threadNumber == 0)
+		threadNumber = std::thread::hardware_concurrency();
+	if (threadNumber == 0)
+		threadNumber = 1;
+
+	for (size_t i = 0; i < threadNumber; i++)
+		_threads.push_back(std::thread(&ArgExecutor::_work, this));
+}
+
+ArgExecutor::~ArgExecutor()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wakeUp.notify_all();
+	for (size_t i = 0; i < _threads.size(); i++)
+		_threads[i].join();
+}
+
+ArgExecutor& ArgExecutor::shared()
+{
+	static ArgExecutor executor;
+	return executor;
+}
+
+void ArgExecutor::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push_back(std::move(task));
+	}
+	_wakeUp.notify_one();
+}
+
+void ArgExecutor::_work()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wakeUp.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+			if (_tasks.empty())
+				return;	// stopping, and nothing left to run
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+std::future<int> runAsync(Subcommand& cmd, ArgExecutor& executor)
+{
+	// std::function needs a copyable task
+	std::shared_ptr<std::packaged_task<int()> > task = std::make_shared<std::packaged_task<int()> >([&cmd] { return cmd.run(); });
+	std::future<int> result = task->get_future();
+	executor.submit([task] { (*task)(); });
+	return result;
+}
+
+SubcommandPipeline::SubcommandPipeline()
+{
+	_finishedNumber = 0;
+}
+
+size_t SubcommandPipeline::addStep(Subcommand* cmd)
+{
+	Step step;
+	step.cmd = cmd;
+	step.dependencyNumber = 0;
+	step.pendingNumber = 0;
+	step.exitCode = 0;
+	step.finished = false;
+	step.skipped = false;
+	_steps.push_back(step);
+	return _steps.size() - 1;
+}
+
+bool SubcommandPipeline::addDependency(size_t step, size_t requiredStep)
+{
+	// only backward edges, so there is no cycle
+	if (step >= _steps.size() || requiredStep >= step)
+		return false;
+
+	_steps[requiredStep].dependents.push_back(step);
+	_steps[step].dependencyNumber++;
+	return true;
+}
+
+void SubcommandPipeline::clear()
+{
+	_steps.clear();
+}
+
+int SubcommandPipeline::run(ArgExecutor& executor)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_finishedNumber = 0;
+	for (size_t i = 0; i < _steps.size(); i++)
+	{
+		Step& s = _steps[i];
+		s.pendingNumber = s.dependencyNumber;
+		s.exitCode = 0;
+		s.finished = false;
+		s.skipped = false;
+	}
+
+	for (size_t i = 0; i < _steps.size(); i++)
+	{
+		if (_steps[i].dependencyNumber == 0)
+			_start(i, executor);
+	}
+	_allFinished.wait(lock, [this] { return _finishedNumber == _steps.size(); });
+
+	for (size_t i = 0; i < _steps.size(); i++)
+	{
+		if (!_steps[i].skipped && _steps[i].exitCode != 0)
+			return _steps[i].exitCode;
+	}
+	return 0;
+}
+
+void SubcommandPipeline::_start(size_t step, ArgExecutor& executor)
+{
+	Subcommand* cmd = _steps[step].cmd;
+	executor.submit([this, step, cmd, &executor]
+	{
+		int exitCode;
+		{
+			ArgProfileScope profile("run");
+			exitCode = cmd->run();
+		}
+		_finish(step, exitCode, executor);
+	});
+}
+
+void SubcommandPipeline::_finish(size_t step, int exitCode, ArgExecutor& executor)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Step& s = _steps[step];
+	s.exitCode = exitCode;
+	s.finished = true;
+	_finishedNumber++;
+
+	for (size_t i = 0; i < s.dependents.size(); i++)
+	{
+		size_t dependent = s.dependents[i];
+		if (exitCode != 0)
+			_skip(dependent);
+		else if (--_steps[dependent].pendingNumber == 0 && !_steps[dependent].skipped)
+			_start(dependent, executor);
+	}
+
+	// notified under the lock: run() may return and the pipeline be destroyed right after
+	if (_finishedNumber == _steps.size())
+		_allFinished.notify_all();
+}
+
+void SubcommandPipeline::_skip(size_t step)
+{
+	Step& s = _steps[step];
+	if (s.finished)
+		return;
+	s.finished = true;
+	s.skipped = true;
+	_finishedNumber++;
+
+	for (size_t i = 0; i < s.dependents.size(); i++)
+		_skip(s.dependents[i]);
+}
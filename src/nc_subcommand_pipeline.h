@@ -0,0 +1,121 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_argparse.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+A fixed pool of threads running the submitted tasks in order.
+The destructor runs the tasks that are still queued, then joins the threads.
+*/
+class ArgExecutor
+{
+public:
+	// threadNumber 0 means one thread per hardware thread
+	explicit ArgExecutor(size_t threadNumber = 0);
+	~ArgExecutor();
+
+	void submit(std::function<void()> task);
+	forceinline size_t threadNumber() { return _threads.size(); }
+
+	// The pool shared by the whole process, created on first use.
+	static ArgExecutor& shared();
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _wakeUp;
+	std::deque<std::function<void()> > _tasks;
+	std::vector<std::thread> _threads;
+	bool _stopping;
+
+	void _work();
+
+	ArgExecutor(const ArgExecutor&);
+	ArgExecutor& operator=(const ArgExecutor&);
+};
+
+// Runs cmd.run() on the executor. The command must live until the future is ready.
+std::future<int> runAsync(Subcommand& cmd, ArgExecutor& executor = ArgExecutor::shared());
+
+/*
+Runs several subcommands of one invocation, e.g. "tool fetch && tool index" in one process:
+
+	SubcommandPipeline pipeline;
+	size_t fetch = pipeline.addStep(&fetchCommand);
+	size_t index = pipeline.addStep(&indexCommand);
+	pipeline.addStep(&lintCommand);
+	pipeline.addDependency(index, fetch);
+	return pipeline.run();
+
+The steps without pending dependencies run concurrently on the executor. A step whose
+dependency failed (non-zero exit code) is skipped, and so are the steps depending on it.
+run() blocks, so it must not be called from a task of the same executor.
+*/
+class SubcommandPipeline
+{
+public:
+	SubcommandPipeline();
+
+	// The pipeline doesn't own the command. Returns the index of the step.
+	size_t addStep(Subcommand* cmd);
+	// "step" runs after "requiredStep" succeeded. requiredStep must be added before step.
+	bool addDependency(size_t step, size_t requiredStep);
+
+	void clear();
+
+	// 0 if every step succeeded, otherwise the exit code of the first failed step.
+	int run(ArgExecutor& executor = ArgExecutor::shared());
+
+	forceinline size_t stepNumber() { return _steps.size(); }
+	forceinline int exitCode(size_t step) { return _steps[step].exitCode; }
+	forceinline bool skipped(size_t step) { return _steps[step].skipped; }
+
+private:
+	struct Step
+	{
+		Subcommand* cmd;
+		std::vector<size_t> dependents;
+		size_t dependencyNumber;
+		size_t pendingNumber;
+		int exitCode;
+		bool finished;
+		bool skipped;
+	};
+
+	std::vector<Step> _steps;
+	std::mutex _mutex;
+	std::condition_variable _allFinished;
+	size_t _finishedNumber;
+
+	void _start(size_t step, ArgExecutor& executor);
+	void _finish(size_t step, int exitCode, ArgExecutor& executor);
+	void _skip(size_t step);
+};
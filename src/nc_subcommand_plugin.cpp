@@ -0,0 +1,215 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_subcommand_plugin.h"
+#include "nc_arg_line_parser.h"
+#include <algorithm>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <dlfcn.h>
+#endif
+
+static void* _openLibrary(const char* path)
+{
+#if defined(_WIN32)
+	return (void*)LoadLibraryA(path);
+#else
+	return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void* _findSymbol(void* library, const char* name)
+{
+#if defined(_WIN32)
+	return (void*)GetProcAddress((HMODULE)library, name);
+#else
+	return dlsym(library, name);
+#endif
+}
+
+static void _closeLibrary(void* library)
+{
+#if defined(_WIN32)
+	FreeLibrary((HMODULE)library);
+#else
+	dlclose(library);
+#endif
+}
+
+static bool _isAbsolutePath(const char* path)
+{
+#if defined(_WIN32)
+	return path[0] == '\\' || path[0] == '/' || (path[0] != '\0' && path[1] == ':');
+#else
+	return path[0] == '/';
+#endif
+}
+
+SubcommandPlugins::SubcommandPlugins(DiagnosticSink* sink)
+{
+	_sink = sink != NULL ? sink : StdioDiagnosticSink::instance();
+}
+
+SubcommandPlugins::~SubcommandPlugins()
+{
+	_unload();
+}
+
+void SubcommandPlugins::_unload()
+{
+	for (size_t i = 0; i < _plugins.size(); i++)
+	{
+		if (_plugins[i].library != NULL)
+			_closeLibrary(_plugins[i].library);
+	}
+	_plugins.clear();
+	_names.clear();
+}
+
+bool SubcommandPlugins::load(const char* manifestFileName)
+{
+	FILE* fp = fopen(manifestFileName, "rb");
+	if (fp == NULL)
+	{
+		_sink->report(ArgError_invalidValue, manifestFileName, "Cannot open the plugin manifest");
+		return false;
+	}
+
+	std::vector<char> text;
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) != 0)
+		text.insert(text.end(), buffer, buffer + n);
+	fclose(fp);
+
+	std::string directory(manifestFileName);
+	size_t slash = directory.find_last_of("/\\");
+	directory = slash != std::string::npos ? directory.substr(0, slash) : ".";
+	return loadText(text.empty() ? "" : &text[0], text.size(), directory.c_str());
+}
+
+bool SubcommandPlugins::loadText(const char* text, size_t textLength, const char* baseDirectory)
+{
+	_unload();
+
+	std::vector<char> line;
+	const char* p = text;
+	const char* end = text + textLength;
+	while (p < end)
+	{
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == NULL)
+			lineEnd = end;
+		line.assign(p, lineEnd);
+		line.push_back('\0');
+		p = lineEnd + 1;
+
+		// name, library and the optional factory, quoted like in a shell
+		char* words[4];
+		size_t wordNumber = 0;
+		size_t position = 0;
+		bool incomplete = false;
+		char* word;
+		while (wordNumber < 4 && (word = ArgLineParser::nextWord(&line[0], line.size() - 1, &position, &line[0], &incomplete)) != NULL)
+			words[wordNumber++] = word;
+		if (wordNumber == 0 || words[0][0] == '#')
+			continue;
+		if (wordNumber < 2 || wordNumber > 3 || incomplete)
+		{
+			_sink->report(ArgError_syntaxError, NULL, "Syntax error in the plugin manifest");
+			_unload();
+			return false;
+		}
+
+		Plugin plugin;
+		plugin.name = words[0];
+		if (baseDirectory != NULL && !_isAbsolutePath(words[1]))
+			plugin.path = std::string(baseDirectory) + "/" + words[1];
+		else
+			plugin.path = words[1];
+		plugin.factoryName = wordNumber == 3 ? words[2] : "nc_create_subcommand";
+		plugin.library = NULL;
+		plugin.factory = NULL;
+		_plugins.push_back(plugin);
+	}
+
+	std::stable_sort(_plugins.begin(), _plugins.end(), [](const Plugin& a, const Plugin& b) { return a.name < b.name; });
+	for (size_t i = 0; i < _plugins.size(); i++)
+	{
+		_names += _plugins[i].name;
+		_names += ',';
+	}
+	return true;
+}
+
+SubcommandPlugins::Plugin* SubcommandPlugins::_find(const char* name)
+{
+	if (name == NULL)
+		return NULL;
+
+	// lower bound, the first of duplicated names wins
+	size_t lo = 0, hi = _plugins.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (strcmp(_plugins[mid].name.c_str(), name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < _plugins.size() && _plugins[lo].name == name ? &_plugins[lo] : NULL;
+}
+
+bool SubcommandPlugins::isLoaded(const char* name)
+{
+	Plugin* plugin = _find(name);
+	return plugin != NULL && plugin->factory != NULL;
+}
+
+Subcommand* SubcommandPlugins::create(const char* name)
+{
+	Plugin* plugin = _find(name);
+	if (plugin == NULL)
+		return NULL;
+
+	if (plugin->factory == NULL)
+	{
+		if (plugin->library == NULL)
+			plugin->library = _openLibrary(plugin->path.c_str());
+		if (plugin->library == NULL)
+		{
+			_sink->report(ArgError_invalidValue, plugin->name.c_str(), "Cannot load the plugin");
+			return NULL;
+		}
+
+		plugin->factory = (SubcommandPluginFactory)_findSymbol(plugin->library, plugin->factoryName.c_str());
+		if (plugin->factory == NULL)
+		{
+			_sink->report(ArgError_invalidValue, plugin->name.c_str(), "The plugin has no factory");
+			return NULL;
+		}
+	}
+	return plugin->factory(plugin->name.c_str());
+}
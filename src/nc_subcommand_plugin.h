@@ -0,0 +1,98 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_argparse.h"
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#	define NC_SUBCOMMAND_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#	define NC_SUBCOMMAND_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+// The factory a plugin exports, by default under the name "nc_create_subcommand".
+typedef Subcommand* (*SubcommandPluginFactory)(const char* name);
+
+#define NC_SUBCOMMAND_PLUGIN(Type) \
+	extern "C" NC_SUBCOMMAND_PLUGIN_EXPORT Subcommand* nc_create_subcommand(const char*) { return new Type; }
+
+/*
+Subcommands implemented in shared libraries. The manifest lists them, and only the library
+of the selected subcommand is loaded, so a tool with many subcommands doesn't pay at startup
+for relocating and initializing all of them:
+
+	# name    library (relative to the manifest)    [factory]
+	fetch     plugins/libfetch.so
+	index     plugins/libindex.so                   create_index
+
+	SubcommandPlugins plugins;
+	plugins.load("tool.plugins");
+	parser.setScopeCommands(plugins.names());
+	parser.parse(argc, argv);
+	Subcommand* cmd = plugins.create(parser.getSubcommand(plugins.names()));
+
+The manifest is read once into a sorted index, a lookup never touches the file system.
+The libraries stay loaded until the destructor, delete the subcommands before it.
+*/
+class SubcommandPlugins
+{
+public:
+	// sink NULL means the stdio sink
+	SubcommandPlugins(DiagnosticSink* sink = NULL);
+	~SubcommandPlugins();
+
+	bool load(const char* manifestFileName);
+	// A relative library path is relative to baseDirectory, or to the working directory if it's NULL.
+	bool loadText(const char* text, size_t textLength, const char* baseDirectory = NULL);
+
+	// e.g. "fetch,index," for getSubcommand() and setScopeCommands()
+	forceinline const char* names() { return _names.c_str(); }
+	forceinline size_t size() { return _plugins.size(); }
+
+	// Loads the library on first use. NULL for NULL, an unknown name or a library that can't be loaded.
+	Subcommand* create(const char* name);
+	bool isLoaded(const char* name);
+
+private:
+	struct Plugin
+	{
+		std::string name;
+		std::string path;
+		std::string factoryName;
+		void* library;
+		SubcommandPluginFactory factory;
+	};
+
+	DiagnosticSink* _sink;
+	std::vector<Plugin> _plugins;	// sorted by name
+	std::string _names;
+
+	Plugin* _find(const char* name);
+	void _unload();
+
+	SubcommandPlugins(const SubcommandPlugins&);
+	SubcommandPlugins& operator=(const SubcommandPlugins&);
+};
@@ -0,0 +1,215 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "nc_subcommand_script.h"
+#include "nc_arg_line_parser.h"
+#include <string>
+
+SubcommandScript::SubcommandScript(ArgParser* parser, const char* commaSplittedCommands, SubcommandFactory factory, void* context)
+{
+	_parser = parser;
+	_commandNames = commaSplittedCommands;
+	_factory = factory;
+	_context = context;
+	_errorLine = 0;
+}
+
+SubcommandScript::~SubcommandScript()
+{
+	_clear();
+}
+
+void SubcommandScript::_clear()
+{
+	for (size_t i = 0; i < _subcommands.size(); i++)
+		delete _subcommands[i];
+	_subcommands.clear();
+	_stepNames.clear();
+	_pipeline.clear();
+	_errorLine = 0;
+}
+
+bool SubcommandScript::load(const char* fileName)
+{
+	_clear();
+
+	FILE* fp = fopen(fileName, "rb");
+	if (fp == NULL)
+	{
+		_parser->diagnosticSink()->report(ArgError_invalidValue, fileName, "Cannot open the script");
+		return false;
+	}
+
+	_text.clear();
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) != 0)
+		_text.insert(_text.end(), buffer, buffer + n);
+	fclose(fp);
+
+	return _loadLines();
+}
+
+bool SubcommandScript::loadText(const char* text, size_t textLength)
+{
+	_clear();
+	_text.assign(text, text + textLength);
+	return _loadLines();
+}
+
+bool SubcommandScript::_loadLines()
+{
+	// NUL terminated, so the last word is terminated like the others
+	_text.push_back('\0');
+	char* p = &_text[0];
+	char* end = p + _text.size() - 1;
+
+	size_t lineNumber = 0;
+	while (p < end)
+	{
+		lineNumber++;
+		char* lineEnd = (char*)memchr(p, '\n', end - p);
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		if (!_loadLine(p, lineEnd - p))
+		{
+			_errorLine = lineNumber;
+			return false;
+		}
+		p = lineEnd + 1;
+	}
+	return true;
+}
+
+size_t SubcommandScript::_findStep(const char* name, size_t nameLength)
+{
+	for (size_t i = 0; i < _stepNames.size(); i++)
+	{
+		const char* stepName = _stepNames[i];
+		if (stepName != NULL && strncmp(stepName, name, nameLength) == 0 && stepName[nameLength] == '\0')
+			return i;
+	}
+	return (size_t)-1;
+}
+
+bool SubcommandScript::_loadLine(char* line, size_t lineLength)
+{
+	DiagnosticSink* sink = _parser->diagnosticSink();
+
+	// the line is unquoted in place, a word always ends before the blank or the newline after it
+	size_t position = 0;
+	while (position < lineLength && (line[position] == ' ' || line[position] == '\t'))
+		position++;
+	if (position < lineLength && line[position] == '#')
+		return true;
+
+	bool incomplete = false;
+	char* word;
+	_argv.clear();
+	_argv.push_back((char*)"script");
+	while ((word = ArgLineParser::nextWord(line, lineLength, &position, line, &incomplete)) != NULL)
+		_argv.push_back(word);
+	if (incomplete)
+	{
+		sink->report(ArgError_syntaxError, NULL, "Unfinished quote");
+		return false;
+	}
+	if (_argv.size() == 1)
+		return true;	// blank or comment
+	_argv.push_back(NULL);
+
+	_parser->parse((int)_argv.size() - 1, &_argv[0]);
+	const char* commandName = _parser->getSubcommand(_commandNames);
+	if (commandName == NULL)
+		return false;	// reported by the parser
+
+	// the subcommand is an entry of argv, the words after it belong to the subcommand
+	size_t commandIndex = 1;
+	while (commandIndex + 2 < _argv.size() && _argv[commandIndex] != commandName)
+		commandIndex++;
+	_parser->reparse((int)commandIndex + 1, &_argv[0], (int)commandIndex + 1);
+
+	const char* stepName = _parser->getArg("step");
+	const char* after = _parser->getArg("after");
+	if (stepName != NULL && _findStep(stepName, strlen(stepName)) != (size_t)-1)
+	{
+		sink->report(ArgError_syntaxError, stepName, "Duplicate step");
+		return false;
+	}
+
+	Subcommand* cmd = _factory(commandName, _context);
+	if (cmd == NULL)
+	{
+		sink->report(ArgError_unknownSubcommand, commandName, "Unknown subcommand");
+		return false;
+	}
+	_subcommands.push_back(cmd);
+	_stepNames.push_back(stepName);
+	size_t step = _pipeline.addStep(cmd);
+
+	// the value may be a default or shared through a string pool, so it is not split in place
+	const char* name = after;
+	while (name != NULL && *name != '\0')
+	{
+		const char* comma = strchr(name, ',');
+		size_t nameLength = comma != NULL ? (size_t)(comma - name) : strlen(name);
+		size_t requiredStep = _findStep(name, nameLength);
+		if (requiredStep == (size_t)-1 || !_pipeline.addDependency(step, requiredStep))
+		{
+			std::string unknownName(name, nameLength);
+			sink->report(ArgError_missingDependency, unknownName.c_str(), "Unknown step");
+			return false;
+		}
+		name = comma != NULL ? comma + 1 : NULL;
+	}
+
+	ArgProfileScope profile("parseArguments");
+	ArgParser scope(_parser->allocator());
+	scope.setDiagnosticSink(sink);
+	scope.setStringPool(_parser->stringPool());
+	scope.parse((int)(_argv.size() - 1 - commandIndex), &_argv[commandIndex]);
+	if (!cmd->parseArguments(scope))
+		return false;
+	bool unknown = _parser->printUnknownArgs();
+	if (scope.printUnknownArgs() || unknown)
+		return false;
+	return true;
+}
+
+int SubcommandScript::run(ArgExecutor& executor)
+{
+	return _pipeline.run(executor);
+}
+
+int SubcommandScript::runSequentially()
+{
+	for (size_t i = 0; i < _subcommands.size(); i++)
+	{
+		ArgProfileScope profile("run");
+		int exitCode = _subcommands[i]->run();
+		if (exitCode != 0)
+			return exitCode;
+	}
+	return 0;
+}
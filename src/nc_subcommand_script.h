@@ -0,0 +1,98 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_subcommand_pipeline.h"
+
+/*
+Runs a file of command lines in one process, so the steps of a build script share one
+parser and its warm cache instead of forking the program for every step:
+
+	# build.script
+	--step fetch fetch --url http://example.com/data
+	--step index --after fetch index data
+	lint src
+
+	ArgParser parser;
+	SubcommandScript script(&parser, "fetch,index,lint", createSubcommand);
+	if (!script.load("build.script"))
+		return -1;
+	return script.run();
+
+The words are quoted like in a shell, a line starting with "#" is a comment.
+"--step NAME" names a step, "--after a,b" makes it wait for named steps of the previous lines.
+run() runs the steps as soon as their dependencies succeeded, the others in parallel.
+runSequentially() runs them one by one in the order of the file.
+
+Every line is parsed by load() with the same parser, which takes "--step", "--after" and
+the subcommand. The words after the subcommand are parsed by a new parser for every line,
+with the sink, the string pool and the allocator of the first one, so the defaults and the
+choices a subcommand sets don't leak into the next line. A subcommand can keep the argument
+strings, they live as long as the script, but not the other results of the parser.
+*/
+class SubcommandScript
+{
+public:
+	// Returns a new subcommand, deleted by the script, or NULL if the name is unknown.
+	typedef Subcommand* (*SubcommandFactory)(const char* name, void* context);
+
+	SubcommandScript(ArgParser* parser, const char* commaSplittedCommands, SubcommandFactory factory, void* context = NULL);
+	~SubcommandScript();
+
+	/*
+		Replaces the steps with those of the file. Errors are reported to the sink
+		of the parser, errorLine() tells the line (from 1) of the first one.
+	*/
+	bool load(const char* fileName);
+	bool loadText(const char* text, size_t textLength);
+
+	int run(ArgExecutor& executor = ArgExecutor::shared());
+	// Stops at the first failed step and returns its exit code.
+	int runSequentially();
+
+	forceinline size_t stepNumber() { return _subcommands.size(); }
+	forceinline size_t errorLine() { return _errorLine; }
+	forceinline SubcommandPipeline& pipeline() { return _pipeline; }
+
+private:
+	ArgParser* _parser;
+	const char* _commandNames;
+	SubcommandFactory _factory;
+	void* _context;
+
+	std::vector<char> _text;	// the words are unquoted in place
+	std::vector<char*> _argv;
+	std::vector<Subcommand*> _subcommands;
+	std::vector<const char*> _stepNames;
+	SubcommandPipeline _pipeline;
+	size_t _errorLine;
+
+	void _clear();
+	bool _loadLines();
+	bool _loadLine(char* line, size_t lineLength);
+	size_t _findStep(const char* name, size_t nameLength);
+
+	SubcommandScript(const SubcommandScript&);
+	SubcommandScript& operator=(const SubcommandScript&);
+};
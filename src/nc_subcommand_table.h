@@ -0,0 +1,132 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_argparse.h"
+
+/*
+Subcommands registered in a table that is built by the compiler, so the program does
+no registration or sorting at startup and finds a name with one hash probe, rarely more.
+The list is an X-macro, which also gives the names for getSubcommand():
+
+	#define TOOL_SUBCOMMANDS(X) \
+		X("compile", "Compile a file into another file", CompileSubcommand) \
+		X("test", "Run Google Test", TestSubcommand)
+
+	static constexpr SubcommandEntry g_entries[] = { TOOL_SUBCOMMANDS(NC_SUBCOMMAND_ENTRY) };
+	static constexpr SubcommandTable g_subcommands(g_entries);
+	static const char g_names[] = TOOL_SUBCOMMANDS(NC_SUBCOMMAND_NAME);	// "compile,test,"
+
+	const SubcommandEntry* entry = g_subcommands.find(parser.getSubcommand(g_names));
+	Subcommand* cmd = entry != NULL ? entry->create() : NULL;
+*/
+struct SubcommandEntry
+{
+	const char* name;
+	const char* summary;	// one line for the help
+	Subcommand* (*create)();
+};
+
+template <typename T>
+Subcommand* newSubcommand()
+{
+	return new T;
+}
+
+#define NC_SUBCOMMAND_ENTRY(name, summary, Type) SubcommandEntry{ name, summary, &newSubcommand<Type> },
+#define NC_SUBCOMMAND_NAME(name, summary, Type) name ","
+
+// at most half full, so an unknown name stops at an empty slot quickly
+constexpr size_t subcommandTableCapacity(size_t number)
+{
+	size_t capacity = 4;
+	while (capacity < number * 2)
+		capacity *= 2;
+	return capacity;
+}
+
+template <size_t N>
+class SubcommandTable
+{
+public:
+	// Duplicated names: the first one is found.
+	constexpr SubcommandTable(const SubcommandEntry (&entries)[N]) : _entries(entries), _slots(), _hashes()
+	{
+		for (size_t i = 0; i < N; i++)
+		{
+			uint32_t hash = _hash(entries[i].name);
+			size_t slot = hash & (CAPACITY - 1);
+			while (_slots[slot] != 0)
+				slot = (slot + 1) & (CAPACITY - 1);
+			_slots[slot] = (uint32_t)i + 1;
+			_hashes[slot] = hash;
+		}
+	}
+
+	// NULL for NULL or an unknown name.
+	constexpr const SubcommandEntry* find(const char* name) const
+	{
+		if (name == NULL)
+			return NULL;
+
+		uint32_t hash = _hash(name);
+		for (size_t slot = hash & (CAPACITY - 1); _slots[slot] != 0; slot = (slot + 1) & (CAPACITY - 1))
+		{
+			const SubcommandEntry& e = _entries[_slots[slot] - 1];
+			if (_hashes[slot] == hash && _same(e.name, name))
+				return &e;
+		}
+		return NULL;
+	}
+
+	// in the order of registration, e.g. for the help
+	constexpr size_t size() const { return N; }
+	constexpr const SubcommandEntry* begin() const { return _entries; }
+	constexpr const SubcommandEntry* end() const { return _entries + N; }
+
+private:
+	static const size_t CAPACITY = subcommandTableCapacity(N);
+
+	static constexpr uint32_t _hash(const char* s)
+	{
+		uint32_t h = 2166136261u;	// FNV-1a
+		for (; *s != '\0'; s++)
+			h = (h ^ (unsigned char)*s) * 16777619u;
+		return h;
+	}
+
+	static constexpr bool _same(const char* a, const char* b)
+	{
+		while (*a != '\0' && *a == *b)
+		{
+			a++;
+			b++;
+		}
+		return *a == *b;
+	}
+
+	const SubcommandEntry* _entries;
+	uint32_t _slots[CAPACITY];	// index + 1 of the entry, 0 if the slot is empty
+	uint32_t _hashes[CAPACITY];
+};
@@ -0,0 +1,91 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+#include "nc_types.h"
+
+/*
+	Appends text into a caller-provided buffer without allocating.
+	Keeps counting after the buffer is full so the caller can learn the needed size.
+*/
+struct ArgTextWriter
+{
+	char* buffer;
+	size_t bufferSize;
+	size_t length;
+
+	ArgTextWriter(char* buffer_, size_t bufferSize_)
+	{
+		buffer = buffer_;
+		bufferSize = bufferSize_;
+		length = 0;
+		if (bufferSize != 0)
+			buffer[0] = '\0';
+	}
+
+	void append(const char* s, size_t n)
+	{
+		if (length + 1 < bufferSize)
+		{
+			size_t room = bufferSize - 1 - length;
+			memcpy(buffer + length, s, n < room ? n : room);
+			buffer[length + (n < room ? n : room)] = '\0';
+		}
+		length += n;
+	}
+
+	void append(const char* s) { append(s, strlen(s)); }
+
+	void appendJsonString(const char* s)
+	{
+		static const char hex[] = "0123456789abcdef";
+
+		append("\"", 1);
+		const char* run = s;
+		for (; *s != '\0'; s++)
+		{
+			unsigned char c = (unsigned char)*s;
+			if (c >= 0x20 && c != '"' && c != '\\')
+				continue;
+
+			append(run, s - run);
+			run = s + 1;
+			switch (c)
+			{
+			case '"': append("\\\"", 2); break;
+			case '\\': append("\\\\", 2); break;
+			case '\n': append("\\n", 2); break;
+			case '\r': append("\\r", 2); break;
+			case '\t': append("\\t", 2); break;
+			default:
+				{
+					char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+					append(escaped, 6);
+				}
+			}
+		}
+		append(run, s - run);
+		append("\"", 1);
+	}
+};
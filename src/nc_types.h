@@ -23,8 +23,39 @@ SOFTWARE.
 */
 #pragma once
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-#define forceinline __forceinline
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#	define NC_ARGPARSE_HAS_STRING_VIEW 1
+#	include <string_view>
+#else
+#	define NC_ARGPARSE_HAS_STRING_VIEW 0
+#endif
+
+#if defined(_MSC_VER)
+#	define forceinline __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#	define forceinline inline __attribute__((always_inline))
+#else
+#	define forceinline inline
+#endif
+
+// Functions of the library are defined inline when it's used as a header-only library.
+#if defined(NC_ARGPARSE_HEADER_ONLY)
+#	define NC_ARGPARSE_INLINE inline
+#else
+#	define NC_ARGPARSE_INLINE
+#endif
+
+// Counters of ArgParser::stats(), on by default in debug builds.
+#if !defined(NC_ARGPARSE_STATS)
+#	if defined(NDEBUG)
+#		define NC_ARGPARSE_STATS 0
+#	else
+#		define NC_ARGPARSE_STATS 1
+#	endif
+#endif
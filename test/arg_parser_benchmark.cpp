@@ -0,0 +1,206 @@
+#include <chrono>
+#include "../src/nc_argparse.h"
+#include "../src/nc_completion.h"
+#include "../src/nc_arg_line_parser.h"
+
+/*
+	Micro benchmarks of the common paths. Also the training run of the profile-guided build.
+
+	nc_argparse_benchmark [--iterations N]
+*/
+
+#define element_of(o) (sizeof(o) / sizeof(o[0]))
+
+typedef std::chrono::steady_clock Clock;
+
+static size_t g_iterations = 100000;
+static volatile size_t g_sink;	// keeps the results alive
+
+static void report(const char* name, Clock::time_point start, size_t operationNumber)
+{
+	double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	printf("%-24s %10.1f ns/op\n", name, ns / operationNumber);
+}
+
+static void benchParse()
+{
+	char* argv[] = {"argparse", "compile", "a.c", "b.o", "--mode", "slow", "-i", "--output", "out", "-j", "8", "--verbose"};
+
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+	{
+		ArgParser parser;
+		parser.parse(element_of(argv), argv);
+		g_sink += parser.getPositionalArgNumber();
+	}
+	report("parse (new parser)", start, g_iterations);
+
+	ArgParser parser;
+	start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+	{
+		parser.parse(element_of(argv), argv);
+		g_sink += parser.getPositionalArgNumber();
+	}
+	report("parse (reused parser)", start, g_iterations);
+}
+
+static void benchGetArg()
+{
+	char* argv[] = {"argparse", "compile", "a.c", "b.o", "--mode", "slow", "-i", "--output", "out", "-j", "8", "--verbose"};
+
+	ArgParser parser;
+	parser.parse(element_of(argv), argv);
+	parser.bindAliaseName("o", "output");
+	parser.bindAliaseName("t", "thread-num");
+	parser.setDefault("thread-num", "1");
+
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+	{
+		g_sink += parser.hasArg("h", "help");
+		g_sink += parser.argEquals("mode", "fast");
+		g_sink += (size_t)parser.getArg("o");
+		g_sink += (size_t)parser.getArg("t");
+	}
+	report("getArg", start, g_iterations * 5);
+}
+
+static bool benchGetAll()
+{
+	const size_t includeNumber = 1000;
+	char** argv = new char*[includeNumber * 2 + 1];
+	argv[0] = (char*)"argparse";
+	for (size_t i = 0; i < includeNumber; i++)
+	{
+		argv[i * 2 + 1] = (char*)"-I";
+		argv[i * 2 + 2] = (char*)"include/path";
+	}
+
+	ArgParser parser;
+	parser.parse(includeNumber * 2 + 1, argv);
+	parser.getAll("I");
+	size_t allocations = parser.stats().allocations;
+
+	size_t iterations = g_iterations / 1000 + 1;
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < iterations; i++)
+	{
+		parser.parse(includeNumber * 2 + 1, argv);
+		ArgValues values = parser.getAll("I");
+		for (const char* v : values)
+			g_sink += (size_t)v;
+	}
+	report("parse+getAll(1000)", start, iterations);
+
+	delete[] argv;
+
+	// a warm parser must not allocate
+	if (parser.stats().allocations != allocations)
+	{
+		printf("error: %d allocations after warm-up\n", (int)(parser.stats().allocations - allocations));
+		return false;
+	}
+	return true;
+}
+
+static void benchSubcommand()
+{
+	char* argv[] = {"argparse", "index", "--help"};
+
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+	{
+		ArgParser parser;
+		parser.parse(element_of(argv), argv);
+		g_sink += (size_t)parser.getSubcommand("fetch,build,compile,test,index,install");
+	}
+	report("parse+getSubcommand", start, g_iterations);
+}
+
+static void benchCompletion()
+{
+	ArgCompleter completer;
+	completer.addSubcommands("fetch,build,compile,test,index,install,config,clean");
+	completer.addOptions(NULL, "h,help,version,verbose");
+	completer.addOptions("compile", "mode,i,interactive,include,output,o");
+
+	char* words[] = {"compile", "--in"};
+	CompletionCandidate candidates[16];
+
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+		g_sink += completer.complete(element_of(words), words, candidates, element_of(candidates));
+	report("complete", start, g_iterations);
+}
+
+static void benchLineParser()
+{
+	// one parse per keystroke, the last word of a long line is being typed
+	char line[512] = "compile a.c b.o --mode slow -i --output 'my out' -j 8 --verbose -I include/path -I";
+	size_t prefixLength = strlen(line);
+	const char* word = " src/generated/include";
+	size_t wordLength = strlen(word);
+
+	ArgParser parser;
+	ArgLineParser lineParser(&parser, "argparse");
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+	{
+		size_t n = i % wordLength + 1;
+		memcpy(line + prefixLength, word, n);
+		lineParser.parse(line, prefixLength + n);
+		g_sink += (size_t)parser.getArg("verbose");
+	}
+	report("line parse (keystroke)", start, g_iterations);
+}
+
+static bool benchStringPool()
+{
+	// the lines of a batch manifest repeat the names and most of the values
+	char* argv[] = {"argparse", "compile", "a.c", "--mode", "fast", "--target", "x64", "--level", "2"};
+
+	ArgStringPool pool;
+	ArgStringId fast = pool.intern("fast");
+	ArgParser parser;
+	parser.setStringPool(&pool);
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < g_iterations; i++)
+	{
+		parser.parse(element_of(argv), argv);
+		g_sink += parser.argIdEquals("mode", fast);
+	}
+	report("parse+argIdEquals (pool)", start, g_iterations);
+
+	// fast, mode, target, x64, level and 2
+	if (pool.size() != 6)
+	{
+		printf("error: %d strings interned\n", (int)pool.size());
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	ArgParser parser;
+	parser.parse(argc, argv);
+
+	const char* iterations = parser.getArg("iterations");
+	if (iterations != NULL)
+		g_iterations = (size_t)atol(iterations);
+	if (parser.printUnknownArgs())
+		return -1;
+
+	benchParse();
+	benchGetArg();
+	if (!benchGetAll())
+		return 1;
+	benchSubcommand();
+	benchCompletion();
+	benchLineParser();
+	if (!benchStringPool())
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*
+MIT License
+
+Copyright (c) 2019 GIS Core R&D Department, NavInfo Co., Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <vector>
+#include "../src/nc_argparse.h"
+#include "../src/nc_arg_line_parser.h"
+
+/*
+	libFuzzer harness of parse(), the queries, getSubcommand(), parseScope() and ArgLineParser.
+
+	cmake -S . -B fuzz -DCMAKE_CXX_COMPILER=clang++ -DNC_ARGPARSE_FUZZ=ON
+	cmake --build fuzz --target nc_argparse_fuzzer
+	fuzz/nc_argparse_fuzzer -max_len=4096 test/fuzz_corpus
+
+	The first byte of an input picks the parser options, the rest are the arguments, one per line.
+	The rest is also tokenized as a shell line by ArgLineParser.
+	Built without libFuzzer, the program runs the files given on its command line.
+*/
+
+enum FuzzFlag
+{
+	FuzzFlag_lazy = 1,
+	FuzzFlag_prefixMatching = 2,
+	FuzzFlag_scopes = 4,
+	FuzzFlag_valueNumber = 8,
+	FuzzFlag_choices = 16,
+	FuzzFlag_reparse = 32,
+	FuzzFlag_windowsSyntax = 64
+};
+
+static const char g_commands[] = "compile,comp,help,script,x";
+
+static void queryParser(ArgParser& parser, uint8_t flags)
+{
+	static const ArgChoice modes[] = { {"fast", 1}, {"slow", 2} };
+
+	parser.bindAliaseName("o", "output");
+	parser.setDefault("j", "1");
+	if (flags & FuzzFlag_prefixMatching)
+	{
+		parser.setPrefixMatching(true);
+		parser.addOption("mode");
+		parser.addOption("module");
+		parser.addOption("output");
+	}
+	if (flags & FuzzFlag_valueNumber)
+		parser.setValueNumber("I", 2);
+	if (flags & FuzzFlag_choices)
+		parser.bindChoices("mode", modes);
+
+	volatile size_t sink = 0;
+	sink += parser.getArg("o") != NULL;
+	sink += parser.hasArg("h", "help");
+	sink += parser.argEquals("mode", "fast");
+	sink += parser.getChoice("mode");
+	sink += parser.getArgSource("j");
+	for (const char* v : parser.getAll("I", ','))
+		sink += v[0];
+
+	for (size_t i = 0; i < parser.getPositionalArgNumber(); i++)
+		sink += parser.getPositionalArgByIndex(i)[0];
+
+	const char* unknownArg;
+	while ((unknownArg = parser.nextUnknownArg()) != NULL)
+		sink += unknownArg[0];
+
+	char json[64];
+	size_t length = parser.dumpJson(json, sizeof(json));
+	std::vector<char> fullJson(length + 1);
+	parser.dumpJson(fullJson.data(), fullJson.size());
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return 0;
+	uint8_t flags = data[0];
+	const char* line = (const char*)data + 1;
+	size_t lineLength = size - 1;
+
+	// argv from the lines, with the NULL at argv[argc] like main()
+	std::vector<char> text(line, line + lineLength);
+	text.push_back('\0');
+	std::vector<char*> argv;
+	argv.push_back((char*)"fuzz");
+	argv.push_back(text.data());
+	for (size_t i = 0; i < lineLength; i++)
+	{
+		if (text[i] == '\n')
+		{
+			text[i] = '\0';
+			argv.push_back(&text[i + 1]);
+		}
+	}
+	int argc = (int)argv.size();
+	argv.push_back(NULL);
+
+	BufferedDiagnosticSink sink;
+	ArgParser parser;
+	parser.setDiagnosticSink(&sink);
+	parser.setLazyParsing((flags & FuzzFlag_lazy) != 0);
+	if (flags & FuzzFlag_scopes)
+		parser.setScopeCommands(g_commands);
+	if (flags & FuzzFlag_windowsSyntax)
+		parser.parse<WindowsArgSyntax>(argc, argv.data());
+	else
+		parser.parse(argc, argv.data());
+	if (flags & FuzzFlag_reparse)
+		parser.reparse(argc, argv.data(), argc / 2);
+
+	const char* command = parser.getSubcommand(g_commands);
+	queryParser(parser, flags);
+	if (command != NULL)
+	{
+		ArgParser scope;
+		scope.setDiagnosticSink(&sink);
+		scope.parseScope(&parser);
+		queryParser(scope, flags);
+	}
+
+	// the same bytes typed into a shell: the whole line, then half of it, then the whole again
+	ArgParser lineArgs;
+	lineArgs.setDiagnosticSink(&sink);
+	ArgLineParser lineParser(&lineArgs, "fuzz");
+	lineParser.parse(line, lineLength);
+	lineParser.parse(line, lineLength / 2);
+	lineParser.parse(line, lineLength);
+	queryParser(lineArgs, flags);
+	return 0;
+}
+
+#if defined(NC_ARGPARSE_FUZZ_STANDALONE)
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		FILE* fp = fopen(argv[i], "rb");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "error: Cannot open %s\n", argv[i]);
+			return 1;
+		}
+		std::vector<uint8_t> data;
+		int c;
+		while ((c = fgetc(fp)) != EOF)
+			data.push_back((uint8_t)c);
+		fclose(fp);
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+	printf("%d inputs\n", argc - 1);
+	return 0;
+}
+#endif
@@ -1,5 +1,16 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include "gtest/gtest.h"
 #include "../src/nc_argparse.h"
+#include "../src/nc_completion.h"
+#include "../src/nc_arg_validator.h"
+#include "../src/nc_arg_line_parser.h"
+#include "../src/nc_subcommand_script.h"
+#include "../src/nc_subcommand_table.h"
+#include "../src/nc_subcommand_plugin.h"
 
 #define element_of(o) (sizeof(o) / sizeof(o[0]))
 
@@ -98,3 +109,1167 @@ TEST(ArgParser, subcommand)
 		EXPECT_TRUE(o.getSubcommand("help, delete, add") == NULL);
 	}
 }
+
+TEST(ArgParser, diagnosticSink)
+{
+	char* argv[] = {"cmd.exe", "compiel", "--bad\"arg", "x"};
+
+	BufferedDiagnosticSink sink;
+	ArgParser o;
+	o.setDiagnosticSink(&sink);
+	o.parse(element_of(argv), argv);
+
+	EXPECT_TRUE(o.getSubcommand("compile,test") == NULL);
+	EXPECT_TRUE(o.printUnknownArgs());
+	ASSERT_EQ(sink.getDiagnosticNumber(), 2);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).code, ArgError_unknownSubcommand);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).key, string_t("compiel"));
+	EXPECT_EQ(sink.getDiagnosticByIndex(1).code, ArgError_unknownArgument);
+
+	char text[256];
+	size_t textLength = sink.formatText(text, sizeof(text));
+	EXPECT_EQ(textLength, strlen(text));
+	EXPECT_EQ(string_t(text), "error: Unknown subcommand: compiel\nerror: Unknown argument: bad\"arg\n");
+
+	char json[256];
+	sink.formatJson(json, sizeof(json));
+	EXPECT_EQ(string_t(json), "[{\"code\":\"unknownSubcommand\",\"key\":\"compiel\",\"message\":\"Unknown subcommand\"},"
+		"{\"code\":\"unknownArgument\",\"key\":\"bad\\\"arg\",\"message\":\"Unknown argument\"}]");
+
+	char small[8];
+	size_t needed = sink.formatJson(small, sizeof(small));
+	EXPECT_EQ(needed, strlen(json));
+	EXPECT_EQ(string_t(small), string_t(json, 7));
+}
+
+TEST(ArgParser, dumpJson)
+{
+	char* argv[] = {"cmd.exe", "build", "--output", "out.exe", "-j", "4", "in.c", "--bad"};
+
+	ArgParser o;
+	o.parse(element_of(argv), argv);
+	o.bindAliaseName("o", "output");
+	o.bindAliaseName("j", "jobs");
+	o.setDefault("mode", "fast");
+	o.setDefault("o", "a.out");
+	EXPECT_EQ(o.getSubcommand("build"), string_t("build"));
+	o.getArg("output");
+	o.getArg("jobs");
+
+	char json[512];
+	size_t length = o.dumpJson(json, sizeof(json));
+	EXPECT_EQ(length, strlen(json));
+	EXPECT_EQ(string_t(json), "{\"options\":["
+		"{\"key\":\"output\",\"value\":\"out.exe\",\"source\":\"argv\"},"
+		"{\"key\":\"j\",\"value\":\"4\",\"source\":\"argv\"},"
+		"{\"key\":\"bad\",\"value\":\"\",\"source\":\"argv\"},"
+		"{\"key\":\"o\",\"value\":\"out.exe\",\"source\":\"alias\"},"
+		"{\"key\":\"jobs\",\"value\":\"4\",\"source\":\"alias\"},"
+		"{\"key\":\"mode\",\"value\":\"fast\",\"source\":\"default\"}],"
+		"\"positionals\":[\"in.c\"],\"subcommand\":\"build\",\"unknowns\":[\"bad\"]}");
+
+	// dumping doesn't mark anything as used
+	EXPECT_TRUE(o.hasUnknownArgs());
+
+	// a repeated key is dumped once, in either spelling
+	char* argv2[] = {"cmd.exe", "--Output", "a", "--output", "b", "--OUTPUT", "c"};
+	o.setCaseInsensitiveKeys(true);
+	o.parse(element_of(argv2), argv2);
+	o.dumpJson(json, sizeof(json));
+	EXPECT_EQ(string_t(json), "{\"options\":["
+		"{\"key\":\"Output\",\"value\":\"a\",\"source\":\"argv\"},"
+		"{\"key\":\"o\",\"value\":\"a\",\"source\":\"alias\"},"
+		"{\"key\":\"mode\",\"value\":\"fast\",\"source\":\"default\"}],"
+		"\"positionals\":[],\"subcommand\":null,\"unknowns\":[\"Output\",\"output\",\"OUTPUT\"]}");
+}
+
+static string_t completionsOf(ArgCompleter& completer, int wordNumber, char* words[])
+{
+	CompletionCandidate candidates[16];
+	size_t n = completer.complete(wordNumber, words, candidates, element_of(candidates));
+	string_t r;
+	for (size_t i = 0; i < n && i < element_of(candidates); i++)
+	{
+		if (!r.empty())
+			r += " ";
+		r += string_t(candidates[i].text, candidates[i].length);
+	}
+	return r;
+}
+
+TEST(ArgParser, completion)
+{
+	ArgCompleter completer;
+	completer.addSubcommands("compile, test, config");
+	completer.addOptions(NULL, "h,help");
+	completer.addOptions("compile", "mode,i,interactive,include");
+
+	{
+		char* words[] = {"co"};
+		EXPECT_EQ(completionsOf(completer, element_of(words), words), "compile config");
+	}
+	{
+		char* words[] = {""};
+		EXPECT_EQ(completionsOf(completer, element_of(words), words), "compile config test");
+	}
+	{
+		char* words[] = {"compile", "--in"};
+		EXPECT_EQ(completionsOf(completer, element_of(words), words), "include interactive");
+	}
+	{
+		char* words[] = {"test", "--"};
+		EXPECT_EQ(completionsOf(completer, element_of(words), words), "h help");
+	}
+	{
+		char* words[] = {"compile", "a.c"};
+		EXPECT_EQ(completionsOf(completer, element_of(words), words), "");
+	}
+
+	char script[1024];
+	size_t length = ArgCompleter::writeScript(CompletionShell_bash, "nc-argparse", script, sizeof(script));
+	EXPECT_EQ(length, strlen(script));
+	EXPECT_TRUE(strstr(script, "complete -o default -F _nc_argparse_complete nc-argparse\n") != NULL);
+}
+
+TEST(ArgParser, prefixMatching)
+{
+	char* argv[] = {"cmd.exe", "--inter", "--in", "a.c", "--mo", "slow", "-i", "--verbose"};
+
+	BufferedDiagnosticSink sink;
+	ArgParser o;
+	o.setDiagnosticSink(&sink);
+	o.parse(element_of(argv), argv);
+	o.setPrefixMatching(true);
+	o.addOption("interactive");
+	o.addOption("include");
+	o.addOption("verbose");
+	o.setDefault("mode", "fast");
+
+	EXPECT_TRUE(o.hasArg("interactive"));
+	EXPECT_EQ(o.getArg("mode"), string_t("slow"));
+	EXPECT_EQ(o.getArg("verbose"), string_t(""));
+	EXPECT_FALSE(o.hasArg("include"));
+	EXPECT_TRUE(o.hasArg("i"));	// short arguments are never abbreviations
+
+	ASSERT_EQ(sink.getDiagnosticNumber(), 1);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).code, ArgError_ambiguousArgument);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).key, string_t("in"));
+	EXPECT_EQ(o.nextUnknownArg(), string_t("in"));
+	EXPECT_TRUE(o.nextUnknownArg() == NULL);
+}
+
+TEST(ArgParser, getAll)
+{
+	char* argv[] = {"cmd.exe", "-I", "a", "--include", "b,c", "src", "-I", "d", "--point", "1", "2", "3", "dest"};
+
+	ArgParser o;
+	o.setValueNumber("point", 3);
+	o.parse(element_of(argv), argv);
+	o.bindAliaseName("I", "include");
+	o.setDefault("define", "X=1,Y=2");
+
+	ArgValues includes = o.getAll("include", ',');
+	ASSERT_EQ(includes.size(), 4);
+	EXPECT_EQ(includes[0], string_t("a"));
+	EXPECT_EQ(includes[1], string_t("b"));
+	EXPECT_EQ(includes[2], string_t("c"));
+	EXPECT_EQ(includes[3], string_t("d"));
+
+	ArgValues unsplitted = o.getAll("I");
+	ASSERT_EQ(unsplitted.size(), 3);
+	EXPECT_EQ(unsplitted[1], string_t("b,c"));
+
+	string_t point;
+	for (const char* v : o.getAll("point"))
+		point += v;
+	EXPECT_EQ(point, "123");
+	EXPECT_EQ(o.getArg("point"), string_t("1"));
+
+	ArgValues defines = o.getAll("define", ',');
+	ASSERT_EQ(defines.size(), 2);
+	EXPECT_EQ(defines[1], string_t("Y=2"));
+
+	EXPECT_EQ(o.getAll("nonExist").size(), 0);
+	EXPECT_FALSE(o.hasUnknownArgs());
+	ASSERT_EQ(o.getPositionalArgNumber(), 2);
+	EXPECT_EQ(o.getPositionalArgByIndex(1), string_t("dest"));
+}
+
+TEST(ArgParser, stringView)
+{
+	char* argv[] = {"cmd.exe", "--mode", "fast", "-o", "out.exe", "--modes"};
+
+	ArgParser o;
+	o.parse(element_of(argv), argv);
+	o.bindAliaseName("o", "output");
+
+	// keys cut from a larger buffer, not NUL terminated
+	const char* buffer = "output,mode,modes";
+	std::string_view output(buffer, 6), mode(buffer + 7, 4), modes(buffer + 12, 5);
+
+	EXPECT_EQ(o.getArg(output), string_t("out.exe"));
+	EXPECT_TRUE(o.argEquals(mode, std::string_view("fastest", 4)));
+	EXPECT_FALSE(o.argEquals(mode, std::string_view("fa")));
+	EXPECT_TRUE(o.hasArg(std::string_view("help"), modes));
+	EXPECT_FALSE(o.hasArg(std::string_view("mod")));
+	EXPECT_FALSE(o.hasUnknownArgs());
+}
+
+TEST(ArgParser, reuse)
+{
+	char* argv1[] = {"cmd.exe", "compile", "--mode", "slow", "--bad", "a.c"};
+	char* argv2[] = {"cmd.exe", "test", "-m", "fast"};
+
+	ArgParser o;
+	o.bindAliaseName("m", "mode");
+	o.setDefault("mode", "fast");
+
+	o.parse(element_of(argv1), argv1);
+	EXPECT_EQ(o.getSubcommand("compile,test"), string_t("compile"));
+	EXPECT_EQ(o.getArg("mode"), string_t("slow"));
+	EXPECT_TRUE(o.hasUnknownArgs());
+
+	o.parse(element_of(argv2), argv2);
+	o.bindAliaseName("m", "mode");	// binding again is harmless
+	o.setDefault("mode", "slow");	// replaces the previous default
+	EXPECT_EQ(o.getSubcommand("compile,test"), string_t("test"));
+	EXPECT_EQ(o.getPositionalArgNumber(), 0);
+	EXPECT_TRUE(o.hasUnknownArgs());
+	EXPECT_EQ(o.getArg("mode"), string_t("fast"));
+	EXPECT_FALSE(o.hasUnknownArgs());
+
+	o.reset();
+	EXPECT_FALSE(o.hasUnknownArgs());
+	EXPECT_EQ(o.getPositionalArgNumber(), 0);
+	EXPECT_EQ(o.getArg("mode"), string_t("slow"));
+}
+
+TEST(ArgParser, lookupCache)
+{
+	char* argv[] = {"cmd.exe", "-o", "out.exe", "--mode", "slow"};
+
+	ArgParser o;
+	o.parse(element_of(argv), argv);
+
+	// a negative result is cached, and dropped when the schema changes
+	EXPECT_TRUE(o.getArg("output") == NULL);
+	o.bindAliaseName("o", "output");
+	EXPECT_EQ(o.getArg("output"), string_t("out.exe"));
+	EXPECT_TRUE(o.getArg("thread-num") == NULL);
+	o.setDefault("thread-num", "1");
+	EXPECT_EQ(o.getArg("thread-num"), string_t("1"));
+	o.setDefault("thread-num", "2");
+	EXPECT_EQ(o.getArg("thread-num"), string_t("2"));
+
+	// the same buffer reused for another key
+	char key[16];
+	strcpy(key, "mode");
+	EXPECT_EQ(o.getArg(key), string_t("slow"));
+	strcpy(key, "o");
+	EXPECT_EQ(o.getArg(key), string_t("out.exe"));
+
+	// a hit still marks the argument as used
+	o.parse(element_of(argv), argv);
+	EXPECT_TRUE(o.hasUnknownArgs());
+	EXPECT_TRUE(o.hasArg("mode"));
+	EXPECT_TRUE(o.hasArg("output"));
+	EXPECT_FALSE(o.hasUnknownArgs());
+}
+
+class CountingAllocator : public ArgAllocator
+{
+public:
+	CountingAllocator() : allocations(0), liveBytes(0), maxSize((size_t)-1) {}
+
+	virtual void* allocate(size_t size) override
+	{
+		if (size > maxSize)
+			return NULL;
+		allocations++;
+		liveBytes += size;
+		return malloc(size);
+	}
+
+	virtual void deallocate(void* p, size_t size) override
+	{
+		liveBytes -= size;
+		free(p);
+	}
+
+	size_t allocations;
+	size_t liveBytes;
+	size_t maxSize;	// bigger allocations fail
+};
+
+TEST(ArgParser, allocator)
+{
+	std::vector<std::string> strings;
+	std::vector<char*> argv;
+	strings.push_back("cmd.exe");
+	for (int i = 0; i < 1000; i++)
+	{
+		strings.push_back("-I");
+		strings.push_back("path" + std::to_string(i));
+	}
+	strings.push_back("--mode");
+	for (size_t i = 0; i < strings.size(); i++)
+		argv.push_back(&strings[i][0]);
+
+	CountingAllocator allocator;
+	{
+		ArgParser o(&allocator);
+		o.parse((int)argv.size(), argv.data());
+		o.setDefault("thread-num", "4");
+		EXPECT_EQ(o.getAll("I").size(), 1000);
+		EXPECT_EQ(o.getAll("I")[999], string_t("path999"));
+
+		// the first reuse merges the blocks of the arena, then the parser doesn't allocate any more
+		o.parse((int)argv.size(), argv.data());
+		EXPECT_EQ(o.getAll("I").size(), 1000);
+		EXPECT_EQ(o.getAll("I").size(), 1000);
+		size_t allocations = allocator.allocations;
+		for (int i = 0; i < 3; i++)
+		{
+			o.parse((int)argv.size(), argv.data());
+			o.setDefault("thread-num", "4");
+			EXPECT_EQ(o.getAll("I").size(), 1000);
+			EXPECT_EQ(o.getAll("I")[0], string_t("path0"));
+			EXPECT_EQ(o.getArg("thread-num"), string_t("4"));
+			EXPECT_TRUE(o.hasArg("mode"));
+			EXPECT_TRUE(o.hasArg("mode"));
+		}
+		EXPECT_EQ(allocator.allocations, allocations);
+
+#if NC_ARGPARSE_STATS
+		const ArgParserStats& stats = o.stats();
+		EXPECT_EQ(stats.allocations, allocations);
+		EXPECT_EQ(stats.lookups, 9);
+		EXPECT_EQ(stats.cacheHits, 3);
+		EXPECT_EQ(stats.defaultHits, 3);
+#endif
+	}
+	EXPECT_EQ(allocator.liveBytes, 0);
+
+	// out of memory: no values and one diagnostic
+	BufferedDiagnosticSink sink;
+	ArgParser o(&allocator);
+	o.setDiagnosticSink(&sink);
+	o.parse((int)argv.size(), argv.data());
+	allocator.maxSize = 4096;
+	EXPECT_EQ(o.getAll("I").size(), 0);
+	ASSERT_EQ(sink.getDiagnosticNumber(), 1);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).code, ArgError_outOfMemory);
+}
+
+TEST(ArgParser, validator)
+{
+	ArgValidator validator;
+	int mode = validator.addOption("mode");
+	int output = validator.addOption("o", "output");
+	int toStdout = validator.addOption("stdout");
+	int jobs = validator.addOption("j", "jobs");
+	int level = validator.addOption("level");
+	validator.require(output);
+	validator.setChoices(mode, "fast, slow");
+	validator.setRange(jobs, 1, 64);
+	validator.addExclusiveGroup(validator.maskOf(output) | validator.maskOf(toStdout));
+	validator.addDependency(level, mode);
+	validator.setPositionalArgNumber(1, 2);
+
+	{
+		char* argv[] = {"cmd.exe", "a.c", "--output", "a.o", "--mode", "slow", "-j", "8", "--level", "2"};
+		BufferedDiagnosticSink sink;
+		ArgParser o;
+		o.setDiagnosticSink(&sink);
+		o.parse(element_of(argv), argv);
+		EXPECT_TRUE(validator.validate(o));
+		EXPECT_EQ(sink.getDiagnosticNumber(), 0);
+		EXPECT_EQ(validator.givenOptions(), validator.maskOf(mode) | validator.maskOf(output) | validator.maskOf(jobs) | validator.maskOf(level));
+		EXPECT_FALSE(o.hasUnknownArgs());
+	}
+
+	{
+		char* argv[] = {"cmd.exe", "a.c", "b.c", "c.c", "--stdout", "-o", "a.o", "--mode", "medium", "--jobs", "100", "--level", "2"};
+		BufferedDiagnosticSink sink;
+		ArgParser o;
+		o.setDiagnosticSink(&sink);
+		o.parse(element_of(argv), argv);
+		o.setDefault("mode", "fast");	// a default doesn't satisfy a dependency
+		EXPECT_FALSE(validator.validate(o));
+
+		char text[512];
+		sink.formatText(text, sizeof(text));
+		EXPECT_EQ(string_t(text),
+			"error: Conflicting arguments: o\n"
+			"error: Invalid value: mode\n"
+			"error: Invalid value: j\n"
+			"error: Too many arguments\n");
+	}
+
+	{
+		char* argv[] = {"cmd.exe", "--level", "1"};
+		BufferedDiagnosticSink sink;
+		ArgParser o;
+		o.setDiagnosticSink(&sink);
+		o.parse(element_of(argv), argv);
+		o.setDefault("mode", "fast");
+		EXPECT_FALSE(validator.validate(o));
+
+		char text[512];
+		sink.formatText(text, sizeof(text));
+		EXPECT_EQ(string_t(text),
+			"error: Missing required argument: o\n"
+			"error: Requires another argument: level\n"
+			"error: Too few arguments\n");
+	}
+
+	{
+		// the options before the subcommand are given to the parent scope
+		char* argv[] = {"cmd.exe", "--output", "a.o", "--mode", "slow", "compile", "a.c", "--level", "2"};
+		BufferedDiagnosticSink sink;
+		ArgParser global;
+		global.setDiagnosticSink(&sink);
+		global.setScopeCommands("compile");
+		global.parse(element_of(argv), argv);
+		ArgParser scope;
+		scope.setDiagnosticSink(&sink);
+		scope.parseScope(&global);
+		EXPECT_TRUE(validator.validate(scope));
+		EXPECT_EQ(sink.getDiagnosticNumber(), 0);
+		EXPECT_EQ(validator.givenOptions(), validator.maskOf(mode) | validator.maskOf(output) | validator.maskOf(level));
+		EXPECT_FALSE(global.hasUnknownArgs());
+	}
+}
+
+TEST(ArgParser, choices)
+{
+	enum class Mode { fast, slow };
+	static const ArgChoice modes[] = { { "fast", Mode::fast }, { "slow", Mode::slow } };
+	static const ArgChoice levels[] = { { "low", 1 }, { "high", 9 } };
+
+	char* argv[] = {"cmd.exe", "--mode", "slow", "--level", "medium"};
+
+	BufferedDiagnosticSink sink;
+	ArgParser o;
+	o.setDiagnosticSink(&sink);
+	o.bindChoices("mode", modes);	// resolved by parse()
+	o.parse(element_of(argv), argv);
+	o.bindChoices("level", levels);	// resolved right away
+	o.setDefault("color", "green");
+
+	EXPECT_TRUE(o.getChoice("mode", Mode::fast) == Mode::slow);
+	EXPECT_EQ(o.getChoice("level", 5), 5);
+	EXPECT_EQ(o.getChoice("unbound"), -1);
+	EXPECT_FALSE(o.hasUnknownArgs());
+
+	ASSERT_EQ(sink.getDiagnosticNumber(), 1);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).code, ArgError_invalidValue);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).key, string_t("level"));
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).message, string_t("Invalid value (expected low|high)"));
+
+	// a default goes through the same table
+	char* argv2[] = {"cmd.exe"};
+	o.setDefault("mode", "fast");
+	o.parse(element_of(argv2), argv2);
+	EXPECT_TRUE(o.getChoice("mode", Mode::slow) == Mode::fast);
+	EXPECT_EQ(o.getChoice("level", 5), 5);
+	EXPECT_EQ(sink.getDiagnosticNumber(), 1);
+
+	// the sink keeps copies: the arena of the parser is reused before the formatting
+	std::vector<char*> many(2000, (char*)"-I");
+	many[0] = (char*)"cmd.exe";
+	o.parse((int)many.size(), many.data());
+	EXPECT_EQ(o.getAll("I").size(), 1999);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).message, string_t("Invalid value (expected low|high)"));
+}
+
+TEST(ArgParser, lazyParsing)
+{
+	// only the next entry is looked at, to know it isn't the value of "--version"
+	char* argv[] = {"cmd.exe", "--version", "-v", NULL, NULL};
+	ArgParser o;
+	o.setLazyParsing(true);
+	o.parse(element_of(argv), argv);
+	EXPECT_TRUE(o.hasArg("version"));
+	EXPECT_TRUE(o.hasArg("version"));
+
+	// the same results as the eager parser once everything is queried
+	char* argv2[] = {"cmd.exe", "-I", "a", "input.txt", "--verbose", "-I", "b", "output.txt", "--bad"};
+	o.setDefault("level", "3");
+	o.parse(element_of(argv2), argv2);
+	EXPECT_EQ(o.getArg("I"), string_t("a"));
+	EXPECT_EQ(o.getArg("level"), string_t("3"));
+	EXPECT_TRUE(o.hasArg("verbose"));
+	EXPECT_FALSE(o.hasArg("missing"));
+	ASSERT_EQ(o.getAll("I").size(), 2);
+	EXPECT_EQ(o.getAll("I")[1], string_t("b"));
+	ASSERT_EQ(o.getPositionalArgNumber(), 2);
+	EXPECT_EQ(o.getPositionalArgByIndex(1), string_t("output.txt"));
+	EXPECT_TRUE(o.hasUnknownArgs());
+	EXPECT_EQ(o.nextUnknownArg(), string_t("bad"));
+	EXPECT_EQ(o.nextUnknownArg(), (const char*)NULL);
+}
+
+TEST(ArgParser, lineParser)
+{
+	ArgParser parser;
+	parser.bindAliaseName("i", "interactive");
+	ArgLineParser line(&parser, "repl");
+
+	ASSERT_TRUE(line.parse("compile -i 'my file.c' \"a \\\"b\\\"\" c\\ d"));
+	ASSERT_EQ(line.argc(), 6);
+	EXPECT_EQ(line.argv()[0], string_t("repl"));
+	EXPECT_EQ(line.argv()[3], string_t("my file.c"));
+	EXPECT_EQ(line.argv()[4], string_t("a \"b\""));
+	EXPECT_EQ(line.argv()[5], string_t("c d"));
+	EXPECT_FALSE(line.incomplete());
+	EXPECT_EQ(parser.getSubcommand("compile,test"), string_t("compile"));
+	EXPECT_TRUE(parser.hasArg("interactive"));
+
+	// typing at the end: the first words keep their arguments
+	const char* value = parser.getArg("i");
+	ASSERT_TRUE(line.parse("compile -i 'my file.c' \"a \\\"b\\\"\" c\\ d -o"));
+	EXPECT_EQ(parser.getArg("i"), value);
+	EXPECT_TRUE(parser.hasArg("o"));
+	ASSERT_TRUE(line.parse("compile -i 'my file.c' \"a \\\"b\\\"\" c\\ d -o out"));
+	EXPECT_EQ(parser.getArg("o"), string_t("out"));
+	EXPECT_EQ(parser.getSubcommand("compile,test"), string_t("compile"));
+	ASSERT_EQ(parser.getPositionalArgNumber(), 2);
+	EXPECT_EQ(parser.getPositionalArgByIndex(1), string_t("c d"));
+	EXPECT_EQ(parser.nextUnknownArg(), string_t("i"));	// not queried since this line
+
+	// an edit in the middle and a deleted suffix
+	ASSERT_TRUE(line.parse("compile -x 'my file.c'"));
+	EXPECT_FALSE(parser.hasArg("i"));
+	EXPECT_EQ(parser.getArg("x"), string_t("my file.c"));
+	EXPECT_EQ(parser.getPositionalArgNumber(), 1);
+	ASSERT_TRUE(line.parse("test"));
+	EXPECT_EQ(parser.getSubcommand("compile,test"), string_t("test"));
+	EXPECT_FALSE(parser.hasArg("x"));
+
+	ASSERT_TRUE(line.parse("test 'unfinished"));
+	EXPECT_TRUE(line.incomplete());
+	EXPECT_EQ(line.argv()[2], string_t("unfinished"));
+
+	// the same result as a full parse of a long line
+	std::string text = "compile";
+	for (int i = 0; i < 200; i++)
+		text += " -I dir" + std::to_string(i);
+	ASSERT_TRUE(line.parse(text.c_str()));
+	ASSERT_EQ(parser.getAll("I").size(), 200);
+	EXPECT_EQ(parser.getAll("I")[199], string_t("dir199"));
+	ASSERT_TRUE(line.parse((text + " -v").c_str()));
+	EXPECT_EQ(parser.getAll("I").size(), 200);
+	EXPECT_TRUE(parser.hasArg("v"));
+}
+
+class StepSubcommand : public Subcommand
+{
+public:
+	StepSubcommand(int exitCode, std::atomic<int>* running = NULL) : m_exitCode(exitCode), m_running(running), m_runNumber(0) {}
+
+	virtual void printHelp() {}
+	virtual bool parseArguments(ArgParser&) { return true; }
+	virtual int run()
+	{
+		m_runNumber++;
+		if (m_running == NULL)
+			return m_exitCode;
+
+		// succeeds only if the other step runs at the same time
+		(*m_running)++;
+		for (int i = 0; i < 5000 && *m_running < 2; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return *m_running >= 2 ? m_exitCode : 100;
+	}
+
+	int m_exitCode;
+	std::atomic<int>* m_running;
+	std::atomic<int> m_runNumber;
+};
+
+TEST(ArgParser, subcommandPipeline)
+{
+	ArgExecutor executor(2);
+
+	StepSubcommand single(7);
+	EXPECT_EQ(runAsync(single, executor).get(), 7);
+
+	// independent steps run concurrently
+	std::atomic<int> running(0);
+	StepSubcommand fetch(0, &running), lint(0, &running);
+	SubcommandPipeline pipeline;
+	pipeline.addStep(&fetch);
+	pipeline.addStep(&lint);
+	EXPECT_EQ(pipeline.run(executor), 0);
+
+	// a failed step skips what depends on it, the others still run
+	StepSubcommand build(3), index(0), test(0), doc(0);
+	SubcommandPipeline pipeline2;
+	size_t b = pipeline2.addStep(&build);
+	size_t i = pipeline2.addStep(&index);
+	size_t t = pipeline2.addStep(&test);
+	size_t d = pipeline2.addStep(&doc);
+	EXPECT_TRUE(pipeline2.addDependency(i, b));
+	EXPECT_TRUE(pipeline2.addDependency(t, i));
+	EXPECT_FALSE(pipeline2.addDependency(b, t));	// would be a cycle
+	EXPECT_EQ(pipeline2.run(executor), 3);
+	EXPECT_TRUE(pipeline2.skipped(i));
+	EXPECT_TRUE(pipeline2.skipped(t));
+	EXPECT_FALSE(pipeline2.skipped(d));
+	EXPECT_EQ(index.m_runNumber, 0);
+	EXPECT_EQ(doc.m_runNumber, 1);
+
+	build.m_exitCode = 0;
+	EXPECT_EQ(pipeline2.run(executor), 0);
+	EXPECT_EQ(test.m_runNumber, 1);
+}
+
+class EchoSubcommand : public Subcommand
+{
+public:
+	EchoSubcommand(std::atomic<int>* order, bool failByDefault = false) : m_order(order), m_failByDefault(failByDefault), m_text(NULL), m_exitCode(0), m_position(-1) {}
+
+	virtual void printHelp() {}
+	virtual bool parseArguments(ArgParser& parser)
+	{
+		if (m_failByDefault)
+			parser.setDefault("exit", "3");
+		if (parser.getPositionalArgNumber() != 1)
+			return false;
+		m_text = parser.getPositionalArgByIndex(0);
+		m_exitCode = atoi(parser.getArg("exit") != NULL ? parser.getArg("exit") : "0");
+		return true;
+	}
+	virtual int run()
+	{
+		m_position = (*m_order)++;
+		return m_exitCode;
+	}
+
+	std::atomic<int>* m_order;
+	bool m_failByDefault;
+	const char* m_text;
+	int m_exitCode;
+	int m_position;
+};
+
+struct EchoFactory
+{
+	std::atomic<int> order;
+	std::vector<EchoSubcommand*> created;
+};
+
+static Subcommand* createEcho(const char* name, void* context)
+{
+	bool fail = strcmp(name, "fail") == 0;
+	if (strcmp(name, "echo") != 0 && !fail)
+		return NULL;
+	EchoFactory* factory = (EchoFactory*)context;
+	factory->created.push_back(new EchoSubcommand(&factory->order, fail));
+	return factory->created.back();
+}
+
+TEST(ArgParser, subcommandScript)
+{
+	const char text[] =
+		"# a comment\n"
+		"--step fetch echo 'hello world'\r\n"
+		"\n"
+		"  --step index --after fetch echo index\n"
+		"--after fetch,index echo \"last \\\"step\\\"\" --exit 4";
+
+	EchoFactory factory;
+	factory.order = 0;
+	BufferedDiagnosticSink sink;
+	ArgParser parser;
+	parser.setDiagnosticSink(&sink);
+	SubcommandScript script(&parser, "echo", createEcho, &factory);
+	ASSERT_TRUE(script.loadText(text, sizeof(text) - 1));
+	ASSERT_EQ(script.stepNumber(), 3);
+	EXPECT_EQ(factory.created[0]->m_text, string_t("hello world"));
+	EXPECT_EQ(factory.created[2]->m_text, string_t("last \"step\""));
+
+	ArgExecutor executor(2);
+	EXPECT_EQ(script.run(executor), 4);
+	EXPECT_EQ(factory.created[0]->m_position, 0);
+	EXPECT_EQ(factory.created[1]->m_position, 1);
+	EXPECT_EQ(factory.created[2]->m_position, 2);
+
+	factory.order = 0;
+	EXPECT_EQ(script.runSequentially(), 4);
+	EXPECT_EQ(sink.getDiagnosticNumber(), 0);
+
+	// errors tell the line
+	const char bad[] = "--step a echo x\n--after b echo y\n";
+	EXPECT_FALSE(script.loadText(bad, sizeof(bad) - 1));
+	EXPECT_EQ(script.errorLine(), 2);
+	ASSERT_EQ(sink.getDiagnosticNumber(), 1);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).code, ArgError_missingDependency);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).key, string_t("b"));
+
+	const char unknown[] = "echo x --verbose\n";
+	EXPECT_FALSE(script.loadText(unknown, sizeof(unknown) - 1));
+	EXPECT_EQ(script.errorLine(), 1);
+	ASSERT_EQ(sink.getDiagnosticNumber(), 2);
+	EXPECT_EQ(sink.getDiagnosticByIndex(1).code, ArgError_unknownArgument);
+
+	// the --after list isn't split in place, it may be shared through a pool
+	ArgStringPool pool;
+	parser.setStringPool(&pool);
+	const char shared[] = "--step a echo x\n--step b echo y\n--after a,b echo z\n";
+	EXPECT_TRUE(script.loadText(shared, sizeof(shared) - 1));
+	EXPECT_EQ(script.stepNumber(), 3);
+	EXPECT_STREQ(pool.string(pool.find("a,b", 3)), "a,b");
+	EXPECT_TRUE(script.loadText(shared, sizeof(shared) - 1));
+	parser.setStringPool(NULL);
+
+	// the schema a subcommand sets up stays on its line
+	const char mixed[] = "--step a fail x\necho y\n";
+	SubcommandScript mixedScript(&parser, "echo,fail", createEcho, &factory);
+	factory.created.clear();
+	ASSERT_TRUE(mixedScript.loadText(mixed, sizeof(mixed) - 1));
+	EXPECT_EQ(factory.created[0]->m_exitCode, 3);
+	EXPECT_EQ(factory.created[1]->m_exitCode, 0);
+	EXPECT_TRUE(parser.getArg("exit") == NULL);
+}
+
+TEST(ArgParser, scopes)
+{
+	char* argv[] = {"tool", "-j", "4", "--level", "3", "--verbose", "compile", "a.c", "-j", "8", "--color", "-x"};
+	ArgParser global;
+	global.setScopeCommands("compile,test");
+	global.parse(element_of(argv), argv);
+	EXPECT_EQ(global.getSubcommand("compile,test"), string_t("compile"));
+	EXPECT_EQ(global.getPositionalArgNumber(), 0);
+	EXPECT_EQ(global.getArg("verbose"), string_t(""));	// the subcommand isn't taken as a value
+
+	ArgParser scope;
+	scope.setDefault("level", "1");
+	scope.setDefault("mode", "fast");
+	scope.parseScope(&global);
+	EXPECT_EQ(scope.parent(), &global);
+	EXPECT_EQ(scope.argc(), 6);
+	EXPECT_EQ(scope.argv()[0], string_t("compile"));
+	ASSERT_EQ(scope.getPositionalArgNumber(), 1);
+	EXPECT_EQ(scope.getPositionalArgByIndex(0), string_t("a.c"));
+
+	EXPECT_EQ(scope.getArg("j"), string_t("8"));
+	EXPECT_EQ(global.getArg("j"), string_t("4"));
+	EXPECT_EQ(scope.getArg("level"), string_t("3"));	// given to the parent, before the default
+	EXPECT_EQ(scope.getArg("level"), string_t("3"));	// cached
+	EXPECT_EQ(scope.getArg("mode"), string_t("fast"));
+	EXPECT_TRUE(scope.hasArg("color"));
+	EXPECT_EQ(scope.getArgSource("level"), ArgSource_default);	// only this scope
+
+	// unknown arguments per scope, the parent ones are used through the scope
+	EXPECT_FALSE(global.hasUnknownArgs());
+	EXPECT_EQ(scope.nextUnknownArg(), string_t("x"));
+	EXPECT_EQ(scope.nextUnknownArg(), (const char*)NULL);
+
+	// the lookups cached from the parent follow its changes
+	EXPECT_TRUE(scope.getArg("quiet") == NULL);
+	global.setDefault("quiet", "1");
+	EXPECT_EQ(scope.getArg("quiet"), string_t("1"));
+	argv[4] = (char*)"5";
+	global.reparse(element_of(argv), argv, 4);
+	EXPECT_EQ(scope.getArg("level"), string_t("5"));
+
+	// no subcommand: the scope is empty but still inherits
+	char* argv2[] = {"tool", "--help"};
+	BufferedDiagnosticSink sink;
+	global.setDiagnosticSink(&sink);
+	global.parse(element_of(argv2), argv2);
+	EXPECT_EQ(global.getSubcommand("compile,test"), (const char*)NULL);
+	scope.parseScope(&global);
+	EXPECT_EQ(scope.argc(), 0);
+	EXPECT_TRUE(scope.hasArg("h", "help"));
+	EXPECT_FALSE(global.hasUnknownArgs());
+}
+
+template <int EXIT_CODE>
+class ExitSubcommand : public Subcommand
+{
+public:
+	virtual void printHelp() {}
+	virtual bool parseArguments(ArgParser&) { return true; }
+	virtual int run() { return EXIT_CODE; }
+};
+
+#define TEST_SUBCOMMANDS(X) \
+	X("fetch", "Fetch the data", ExitSubcommand<1>) \
+	X("index", "Index the data", ExitSubcommand<2>) \
+	X("install", "Install the index", ExitSubcommand<3>)
+
+static constexpr SubcommandEntry g_testEntries[] = { TEST_SUBCOMMANDS(NC_SUBCOMMAND_ENTRY) };
+static constexpr SubcommandTable g_testSubcommands(g_testEntries);
+
+// built and searched by the compiler
+static_assert(g_testSubcommands.find("index") == &g_testEntries[1], "constant lookup");
+static_assert(g_testSubcommands.find("ind") == NULL, "constant lookup");
+
+TEST(ArgParser, subcommandTable)
+{
+	static const char names[] = TEST_SUBCOMMANDS(NC_SUBCOMMAND_NAME);
+	EXPECT_EQ(string_t(names), string_t("fetch,index,install,"));
+	EXPECT_EQ(g_testSubcommands.size(), 3);
+
+	char* argv[] = {"tool", "install"};
+	ArgParser parser;
+	parser.parse(element_of(argv), argv);
+	const SubcommandEntry* entry = g_testSubcommands.find(parser.getSubcommand(names));
+	ASSERT_TRUE(entry != NULL);
+	EXPECT_EQ(entry->summary, string_t("Install the index"));
+
+	Subcommand* cmd = entry->create();
+	EXPECT_EQ(cmd->run(), 3);
+	delete cmd;
+
+	EXPECT_TRUE(g_testSubcommands.find("fetch") == &g_testEntries[0]);
+	EXPECT_TRUE(g_testSubcommands.find("unknown") == NULL);
+	EXPECT_TRUE(g_testSubcommands.find(NULL) == NULL);
+}
+
+#if defined(NC_ARGPARSE_TEST_PLUGIN)
+TEST(ArgParser, subcommandPlugins)
+{
+	std::string manifest =
+		"# name  library  [factory]\n"
+		"zip     missing/libzip.so\n"
+		"plugin  '" NC_ARGPARSE_TEST_PLUGIN "'\n"
+		"other   '" NC_ARGPARSE_TEST_PLUGIN "'  no_such_factory\n";
+
+	BufferedDiagnosticSink sink;
+	SubcommandPlugins plugins(&sink);
+	ASSERT_TRUE(plugins.loadText(manifest.c_str(), manifest.size()));
+	EXPECT_EQ(plugins.size(), 3);
+	EXPECT_EQ(string_t(plugins.names()), string_t("other,plugin,zip,"));
+
+	char* argv[] = {"tool", "plugin", "x"};
+	ArgParser parser;
+	parser.setScopeCommands(plugins.names());
+	parser.parse(element_of(argv), argv);
+	const char* name = parser.getSubcommand(plugins.names());
+	EXPECT_FALSE(plugins.isLoaded(name));	// nothing is loaded before it's selected
+
+	Subcommand* cmd = plugins.create(name);
+	ASSERT_TRUE(cmd != NULL);
+	EXPECT_TRUE(plugins.isLoaded(name));
+	EXPECT_EQ(cmd->run(), 42);
+	delete cmd;
+
+	EXPECT_TRUE(plugins.create("unknown") == NULL);
+	EXPECT_TRUE(plugins.create("zip") == NULL);
+	EXPECT_TRUE(plugins.create("other") == NULL);
+	ASSERT_EQ(sink.getDiagnosticNumber(), 2);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).message, string_t("Cannot load the plugin"));
+	EXPECT_EQ(sink.getDiagnosticByIndex(1).message, string_t("The plugin has no factory"));
+
+	const char bad[] = "lonely\n";
+	EXPECT_FALSE(plugins.loadText(bad, sizeof(bad) - 1));
+	EXPECT_EQ(plugins.size(), 0);
+}
+#endif
+
+TEST(ArgParser, profiler)
+{
+	EXPECT_FALSE(ArgProfiler::enable("xml"));
+	ArgProfiler::enable(ArgProfileFormat_text);
+	ArgProfiler::clear();
+
+	char* argv[] = {"tool", "compile", "a.c"};
+	ArgParser parser;
+	parser.parse(element_of(argv), argv);
+	EXPECT_EQ(string_t(parser.getSubcommand("compile")), string_t("compile"));
+	ArgProfiler::disable();
+	parser.parse(element_of(argv), argv);	// not recorded
+
+	// parse, getSubcommand.tokenize, getSubcommand.match, getSubcommand
+	ASSERT_EQ(ArgProfiler::eventNumber(), 4);
+	EXPECT_EQ(string_t(ArgProfiler::eventByIndex(0).name), string_t("parse"));
+	EXPECT_EQ(string_t(ArgProfiler::eventByIndex(3).name), string_t("getSubcommand"));
+	EXPECT_EQ(ArgProfiler::eventByIndex(0).thread, ArgProfiler::eventByIndex(3).thread);
+	EXPECT_LE(ArgProfiler::eventByIndex(0).start, ArgProfiler::eventByIndex(3).start);
+
+	char text[1024];
+	ArgProfiler::writeText(text, sizeof(text));
+	EXPECT_TRUE(strstr(text, "\nparse ") != NULL);
+	EXPECT_TRUE(strstr(text, "\ngetSubcommand.match ") != NULL);
+
+	size_t length = ArgProfiler::writeChromeTrace(NULL, 0);
+	std::string trace(length, '\0');
+	EXPECT_EQ(ArgProfiler::writeChromeTrace(&trace[0], length + 1), length);
+	EXPECT_EQ(trace.find("{\"traceEvents\":[{\"name\":\"parse\",\"ph\":\"X\","), 0);
+	EXPECT_NE(trace.find("\"name\":\"getSubcommand\""), std::string::npos);
+	ArgProfiler::clear();
+}
+
+TEST(ArgParser, unicode)
+{
+	// "北京.txt", an emoji, and an overlong "/"
+	char* argv[] = {"tool", "--Output", "\xE5\x8C\x97\xE4\xBA\xAC.txt", "--MODE", "fast", "\xF0\x9F\x98\x80", "--bad", "\xC0\xAF", NULL};
+
+	BufferedDiagnosticSink sink;
+	ArgParser parser;
+	parser.setDiagnosticSink(&sink);
+	parser.setCaseInsensitiveKeys(true);
+	parser.setUtf8Validation(true);
+	parser.bindAliaseName("o", "OUTPUT");
+	parser.setDefault("Name", "\xE5\x8C\x97");
+	parser.parse(element_of(argv) - 1, argv);
+
+	ASSERT_EQ(sink.getDiagnosticNumber(), 1);
+	EXPECT_EQ(sink.getDiagnosticByIndex(0).code, ArgError_invalidEncoding);
+	EXPECT_TRUE(ArgParser::isValidUtf8(argv[2], strlen(argv[2])));
+	EXPECT_FALSE(ArgParser::isValidUtf8("\xED\xA0\x80", 3));	// a surrogate
+
+	EXPECT_EQ(string_t(parser.getArg("o")), string_t(argv[2]));
+	EXPECT_TRUE(parser.argEquals("Mode", "fast"));
+	EXPECT_EQ(parser.getAll("mode").size(), 1);
+
+	const wchar_t* output = parser.getArgW("output");
+	EXPECT_EQ(std::wstring(output), std::wstring(L"\u5317\u4EAC.txt"));
+	EXPECT_EQ(parser.getArgW("OUTPUT"), output);	// converted once
+	EXPECT_EQ(std::wstring(parser.getPositionalArgByIndexW(0)), std::wstring(L"\U0001F600"));
+	EXPECT_EQ(std::wstring(parser.getArgW("name")), std::wstring(L"\u5317"));
+	EXPECT_EQ(std::wstring(parser.getArgW("bad")), std::wstring(L"\uFFFD\uFFFD"));
+	EXPECT_FALSE(parser.hasUnknownArgs());
+
+	// the kept keys are folded again
+	parser.reparse(element_of(argv) - 1, argv, 5);
+	EXPECT_TRUE(parser.hasArg("output"));
+	EXPECT_EQ(string_t(parser.nextUnknownArg()), string_t("MODE"));
+}
+
+// "+key=value", a policy of the application
+struct PlusArgSyntax
+{
+	enum { caseInsensitive = false, valueNumber = 0 };
+	static size_t switchPrefix(const char* arg) { return arg[0] == '+' && arg[1] != '\0' ? 1 : 0; }
+	static bool isValueSeparator(char c) { return c == '='; }
+};
+
+TEST(ArgParser, windowsSyntax)
+{
+	char* argv[] = {"link.exe", "/OUT:app.exe", "a.obj", "/Machine=x64", "/verbose", "b.obj", "-Debug", "/", "/map:", "/LibPath", "lib", NULL};
+
+	ArgParser parser;
+	parser.bindAliaseName("o", "out");
+	parser.setDefault("Subsystem", "console");
+	parser.setValueNumber("libpath", 1);
+	parser.parse<WindowsArgSyntax>(element_of(argv) - 1, argv);
+
+	EXPECT_EQ(string_t(parser.getArg("o")), string_t("app.exe"));
+	EXPECT_TRUE(parser.argEquals("MACHINE", "x64"));
+	EXPECT_EQ(string_t(parser.getArg("verbose")), string_t());
+	EXPECT_EQ(string_t(parser.getArg("map")), string_t());
+	EXPECT_EQ(string_t(parser.getArg("libpath")), string_t("lib"));
+	EXPECT_EQ(string_t(parser.getArg("subsystem")), string_t("console"));
+	ASSERT_EQ(parser.getPositionalArgNumber(), 3);
+	EXPECT_EQ(string_t(parser.getPositionalArgByIndex(1)), string_t("b.obj"));
+	EXPECT_EQ(string_t(parser.getPositionalArgByIndex(2)), string_t("/"));
+	EXPECT_EQ(string_t(parser.nextUnknownArg()), string_t("Debug"));	// as it was spelled
+	EXPECT_TRUE(parser.nextUnknownArg() == NULL);
+
+	// the default syntax takes the slashes as positional arguments, and the keys keep their case
+	parser.parse(element_of(argv) - 1, argv);
+	EXPECT_FALSE(parser.hasArg("out"));
+	EXPECT_TRUE(parser.getArg("debug") == NULL);
+	EXPECT_EQ(string_t(parser.getArg("Debug")), string_t("/"));
+	EXPECT_TRUE(parser.getArg("subsystem") == NULL);
+	EXPECT_EQ(string_t(parser.getArg("Subsystem")), string_t("console"));
+
+	// a scope takes the syntax of its parent
+	char* scoped[] = {"cl.exe", "/Nologo", "compile", "/Fo:a.obj", NULL};
+	parser.setScopeCommands("compile");
+	parser.parse<WindowsArgSyntax>(element_of(scoped) - 1, scoped);
+	EXPECT_TRUE(parser.hasArg("nologo"));
+	ArgParser scope;
+	scope.parseScope(&parser);
+	EXPECT_EQ(string_t(scope.getArg("fo")), string_t("a.obj"));
+
+	// reparse() keeps the syntax, the keys of the unchanged entries stay valid
+	std::vector<std::string> strings;
+	strings.push_back("link.exe");
+	for (int i = 0; i < 600; i++)
+		strings.push_back("/Key" + std::to_string(i) + ":v");
+	std::vector<char*> many;
+	for (size_t i = 0; i < strings.size(); i++)
+		many.push_back(&strings[i][0]);
+	parser.setScopeCommands(NULL);
+	parser.parse<WindowsArgSyntax>((int)many.size(), many.data());
+	strings.back() = "/Last:w";
+	many.back() = &strings.back()[0];
+	parser.reparse((int)many.size(), many.data(), (int)many.size() - 1);
+	EXPECT_EQ(string_t(parser.getArg("key0")), string_t("v"));
+	EXPECT_EQ(string_t(parser.getArg("KEY598")), string_t("v"));
+	EXPECT_EQ(string_t(parser.getArg("last")), string_t("w"));
+	EXPECT_EQ(string_t(parser.nextUnknownArg()), string_t("Key1"));	// as it was spelled
+
+	char* plus[] = {"tool", "+jobs=4", "-x", "+quiet", NULL};
+	parser.parse<PlusArgSyntax>(element_of(plus) - 1, plus);
+	EXPECT_EQ(string_t(parser.getArg("jobs")), string_t("4"));
+	EXPECT_TRUE(parser.hasArg("quiet"));
+	EXPECT_EQ(parser.getPositionalArgNumber(), 1);
+}
+
+TEST(ArgParser, stringPool)
+{
+	ArgStringPool pool;
+	ArgStringId fast = pool.intern("fast");
+	EXPECT_EQ(pool.intern("fast", 4), fast);
+	EXPECT_EQ(pool.find("slow", 4), 0);
+
+	char value[] = "fast";
+	char* argv1[] = {"tool", "--mode", value, "-j", "4", NULL};
+	char* argv2[] = {"tool", "--mode", "fast", "--Mode", "slow", NULL};
+
+	ArgParser parser1, parser2;
+	parser1.setStringPool(&pool);
+	parser2.setStringPool(&pool);
+	parser1.setDefault("level", "fast");
+	parser1.parse(element_of(argv1) - 1, argv1);
+	parser2.parse(element_of(argv2) - 1, argv2);
+	value[0] = 'X';	// the values point into the pool
+
+	EXPECT_TRUE(parser1.argIdEquals("mode", fast));
+	EXPECT_TRUE(parser2.argIdEquals("mode", fast));
+	EXPECT_TRUE(parser1.argIdEquals("level", fast));
+	EXPECT_EQ(parser1.getArg("mode"), parser2.getArg("mode"));
+	EXPECT_EQ(string_t(pool.string(parser1.getArgId("mode"))), string_t("fast"));
+	EXPECT_EQ(parser1.getArgId("j"), pool.find("4", 1));
+	EXPECT_EQ(parser1.getArgId("missing"), 0);
+	EXPECT_EQ(pool.size(), 6);	// fast, mode, j, 4, Mode, slow
+
+	for (int i = 0; i < 1000; i++)
+	{
+		std::string text = std::to_string(i);
+		ArgStringId id = pool.intern(text.c_str());
+		EXPECT_EQ(pool.find(text.c_str(), text.size()), id);
+	}
+	EXPECT_EQ(pool.size(), 6 + 999);
+	EXPECT_EQ(pool.intern("fast"), fast);
+	EXPECT_EQ(pool.length(fast), 4);
+
+	// every value of a key is interned, and a pool given after parse() waits for the next one
+	char include1[] = "inc", include2[] = "lib";
+	char* argv3[] = {"tool", "-I", include1, include2, NULL};
+	ArgParser parser3;
+	parser3.setValueNumber("I", 2);
+	parser3.parse(element_of(argv3) - 1, argv3);
+	parser3.setStringPool(&pool);
+	EXPECT_EQ(parser3.getArgId("I"), 0);
+	parser3.parse(element_of(argv3) - 1, argv3);
+	include2[0] = 'X';
+	ArgValues includes = parser3.getAll("I");
+	ASSERT_EQ(includes.size(), 2);
+	EXPECT_EQ(string_t(includes[1]), string_t("lib"));
+	EXPECT_EQ(includes[1], pool.string(pool.find("lib", 3)));
+}
+
+// The fastest of a few runs of f(n), in seconds.
+template <typename F>
+static double fastestRun(F f, size_t n)
+{
+	double best = 1e30;
+	for (int i = 0; i < 3; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f(n);
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+// 8 times the input takes about 8 times as long in linear time, 64 times in quadratic time.
+// The caches and page faults make the bigger input up to twice as slow per item, hence the margin.
+template <typename F>
+static double timeGrowth(F f, size_t n)
+{
+	return fastestRun(f, n * 8) / fastestRun(f, n);
+}
+
+// Measures time, so it only runs with "ctest -C timing".
+TEST(ArgParser, DISABLED_linearTime)
+{
+	auto identicalKeys = [](size_t n)
+	{
+		std::vector<char*> argv(n + 2, (char*)"--mod");
+		argv[0] = (char*)"tool";
+		argv[n + 1] = NULL;
+
+		BufferedDiagnosticSink sink;
+		ArgParser parser;
+		parser.setDiagnosticSink(&sink);
+		parser.setPrefixMatching(true);
+		parser.addOption("mode");
+		parser.parse((int)n + 1, argv.data());
+		EXPECT_TRUE(parser.hasArg("mode"));
+		EXPECT_EQ(parser.getAll("mode").size(), n);
+		EXPECT_FALSE(parser.hasUnknownArgs());
+		parser.dumpJson(NULL, 0);
+	};
+
+	auto distinctKeys = [](size_t n)
+	{
+		std::vector<std::string> keys(n);
+		std::vector<char*> argv(1, (char*)"tool");
+		for (size_t i = 0; i < n; i++)
+		{
+			keys[i] = "--key" + std::to_string(i);
+			argv.push_back(&keys[i][0]);
+			argv.push_back((char*)"value");
+		}
+		argv.push_back(NULL);
+
+		BufferedDiagnosticSink sink;
+		ArgParser parser;
+		parser.setDiagnosticSink(&sink);
+		parser.setPrefixMatching(true);
+		parser.addOption("mode");
+		parser.parse((int)argv.size() - 1, argv.data());
+		EXPECT_EQ(parser.getAll("key0").size(), 1);
+		EXPECT_TRUE(parser.printUnknownArgs());
+		EXPECT_EQ(sink.getDiagnosticNumber() + sink.getDroppedNumber(), n - 1);
+		parser.dumpJson(NULL, 0);
+	};
+
+	auto longKeys = [](size_t n)
+	{
+		std::string key = "--" + std::string(n * 16, 'k');
+		std::string nearKey = std::string(n * 16 - 1, 'k') + "x";
+		std::string command(n * 16, 'c');
+		std::string commands = command + "x," + command;
+		char* argv[] = {"tool", &command[0], &key[0], "value", NULL};
+
+		ArgParser parser;
+		parser.setPrefixMatching(true);
+		parser.addOption(nearKey.c_str());
+		parser.parse(element_of(argv) - 1, argv);
+		EXPECT_EQ(parser.getArg(key.c_str() + 2), string_t("value"));
+		EXPECT_TRUE(parser.getArg(nearKey.c_str()) == NULL);
+		EXPECT_TRUE(parser.getSubcommand(commands.c_str()) != NULL);
+	};
+
+	auto nearSubcommands = [](size_t n)
+	{
+		std::string commands;
+		for (size_t i = 0; i < n; i++)
+			commands += "compile" + std::to_string(i) + ",";
+		std::string last = "compile" + std::to_string(n - 1);
+		char* argv[] = {"tool", "-j", "compile", &last[0], "a.c", NULL};
+
+		BufferedDiagnosticSink sink;
+		ArgParser parser;
+		parser.setDiagnosticSink(&sink);
+		parser.setScopeCommands(commands.c_str());
+		parser.parse(element_of(argv) - 1, argv);
+		EXPECT_EQ(string_t(parser.getArg("j")), string_t("compile"));
+		EXPECT_EQ(string_t(parser.getSubcommand(commands.c_str())), last);
+	};
+
+	EXPECT_LT(timeGrowth(identicalKeys, 50000), 32.0);
+	EXPECT_LT(timeGrowth(distinctKeys, 50000), 32.0);
+	EXPECT_LT(timeGrowth(longKeys, 50000), 32.0);
+	EXPECT_LT(timeGrowth(nearSubcommands, 50000), 32.0);
+}
@@ -1,27 +1,58 @@
 #include "gtest/gtest.h"
 #include "../src/nc_argparse.h"
+#include "../src/nc_completion.h"
+#include "../src/nc_arg_validator.h"
+#include "../src/nc_subcommand_script.h"
+#include "../src/nc_subcommand_table.h"
 
 #define APP_NAME  "argparse"
 
-int printHelp()
+/*
+The options of a scope are listed once, like the subcommands, and the help, the validator
+and the completer are made from the list. No alias is "".
+*/
+struct AppOption
 {
-	printf(R"(An example program to demonstrate how to use )" APP_NAME R"(.
-
-Syntax:
+	const char* name;
+	const char* aliaseName;
+	const char* syntax;	// for the help
+	const char* help;
+};
 
-    )" APP_NAME R"( SUBCMD <OPTIONS>
-    )" APP_NAME R"( -h/--help
-    )" APP_NAME R"( SUBCMD -h/--help
+#define APP_OPTION_ENTRY(name, aliaseName, syntax, help) AppOption{ name, aliaseName, syntax, help },
+#define APP_OPTION_NAMES(name, aliaseName, syntax, help) name "," aliaseName ","
 
-Subcommands:
-	
-    compile     Compile a file into another file
-    test        Run Google Test
-)");
+template <size_t N>
+static void printOptions(const AppOption (&options)[N])
+{
+	for (const AppOption& o : options)
+		printf("    %-20s%s\n", o.syntax, o.help);
+	printf("\n");
+}
 
-	return 0;
+template <size_t N>
+static void addOptions(ArgValidator& validator, const AppOption (&options)[N])
+{
+	for (const AppOption& o : options)
+		validator.addOption(o.name, o.aliaseName[0] != '\0' ? o.aliaseName : NULL);
 }
 
+#define APP_GLOBAL_OPTIONS(X) \
+	X("h", "help", "-h --help", "Print the help, of the subcommand if there's one") \
+	X("completion-script", "", "--completion-script", "Print the completion script of bash, zsh or fish") \
+	X("profile", "", "--profile FORMAT", "text|json[:FILE], write the time of the phases at exit")
+
+#define COMPILE_OPTIONS(X) \
+	X("mode", "", "--mode MODE", "\"fast\" or \"slow\". \"fast\" is the default.") \
+	X("i", "interactive", "-i --interactive", "Interactive mode")
+
+#define SCRIPT_OPTIONS(X) \
+	X("sequential", "", "--sequential", "Run the commands one by one instead of in parallel")
+
+static constexpr AppOption g_globalOptions[] = { APP_GLOBAL_OPTIONS(APP_OPTION_ENTRY) };
+static constexpr AppOption g_compileOptions[] = { COMPILE_OPTIONS(APP_OPTION_ENTRY) };
+static constexpr AppOption g_scriptOptions[] = { SCRIPT_OPTIONS(APP_OPTION_ENTRY) };
+
 class TestSubcommand : public Subcommand
 {
 public:
@@ -47,6 +78,12 @@ public:
 class CompileSubcommand : public Subcommand
 {
 public:
+	enum Mode
+	{
+		Mode_fast,
+		Mode_slow
+	};
+
 	void printHelp() override
 	{
 		printf(R"(Compile a source file into a target file.
@@ -57,36 +94,32 @@ Syntax:
 
     SRC                 Source File
     DEST                Target File
-    --mode MODE         "fast" or "slow". "fast" is the default.
-    -i --interactive    Interactive mode
-
 )");
+		printOptions(g_compileOptions);
 	}
 
 	bool parseArguments(ArgParser& parser) override
 	{
-		if (parser.getPositionalArgNumber() != 2)
-		{
-			printf("error: needs two arguments\n");
+		static const ArgChoice modes[] = { { "fast", Mode_fast }, { "slow", Mode_slow } };
+		parser.setDefault("mode", "fast");
+		parser.bindChoices("mode", modes);
+
+		ArgValidator validator;
+		addOptions(validator, g_compileOptions);
+		validator.setPositionalArgNumber(2, 2);
+		if (!validator.validate(parser))
 			return false;
-		}
+
 		m_srcFile = parser.getPositionalArgByIndex(0);
 		m_destFile = parser.getPositionalArgByIndex(1);
-
 		m_interactive = parser.hasArg("i", "interactive");
-		parser.setDefault("mode", "fast");
-		m_mode = parser.getArg("mode");
-		if (strcmp(m_mode, "fast") != 0 && strcmp(m_mode, "slow") != 0)
-		{
-			printf("error: mode should be 'fast' or 'slow'");
-			return false;
-		}
-		return true;
+		m_mode = parser.getChoice("mode", (Mode)-1);
+		return m_mode != (Mode)-1;
 	}
 
 	int run() override
 	{
-		printf("Compiling %s into %s in '%s' mode ... Done\n", m_srcFile, m_destFile, m_mode);
+		printf("Compiling %s into %s in '%s' mode ... Done\n", m_srcFile, m_destFile, m_mode == Mode_fast ? "fast" : "slow");
 		return 0;
 	}
 
@@ -94,44 +127,171 @@ private:
 	const char* m_srcFile;
 	const char* m_destFile;
 	bool m_interactive;
-	const char* m_mode;
+	Mode m_mode;
 };
 
+static Subcommand* createScriptSubcommand(const char* name, void*)
+{
+	if (strcmp(name, "compile") == 0)
+		return new CompileSubcommand;
+	return NULL;
+}
+
+class ScriptSubcommand : public Subcommand
+{
+public:
+	void printHelp() override
+	{
+		printf(R"(Run the commands of a file in one process, one command per line.
+
+Syntax:
+
+    argparse script FILE <OPTIONS>
+
+    FILE                Commands, e.g. "--step a compile x y" and "--after a compile y z"
+)");
+		printOptions(g_scriptOptions);
+	}
+
+	bool parseArguments(ArgParser& parser) override
+	{
+		ArgValidator validator;
+		addOptions(validator, g_scriptOptions);
+		validator.setPositionalArgNumber(1, 1);
+		if (!validator.validate(parser))
+			return false;
+
+		m_fileName = parser.getPositionalArgByIndex(0);
+		m_sequential = parser.hasArg("sequential");
+		return true;
+	}
+
+	int run() override
+	{
+		ArgParser parser;
+		SubcommandScript script(&parser, "compile", createScriptSubcommand);
+		if (!script.load(m_fileName))
+		{
+			printf("error: %s:%d\n", m_fileName, (int)script.errorLine());
+			return -1;
+		}
+		return m_sequential ? script.runSequentially() : script.run();
+	}
+
+private:
+	const char* m_fileName;
+	bool m_sequential;
+};
+
+#define APP_SUBCOMMANDS(X) \
+	X("compile", "Compile a file into another file", CompileSubcommand) \
+	X("test", "Run Google Test", TestSubcommand) \
+	X("script", "Run the commands of a file", ScriptSubcommand)
+
+static constexpr SubcommandEntry g_subcommandEntries[] = { APP_SUBCOMMANDS(NC_SUBCOMMAND_ENTRY) };
+static constexpr SubcommandTable g_subcommands(g_subcommandEntries);
+static const char g_subcommandNames[] = APP_SUBCOMMANDS(NC_SUBCOMMAND_NAME);
+
+static bool parseArguments(Subcommand* cmd, ArgParser& parser)
+{
+	ArgProfileScope profile("parseArguments");
+	return cmd->parseArguments(parser);
+}
+
+int printHelp()
+{
+	printf(R"(An example program to demonstrate how to use )" APP_NAME R"(.
+
+Syntax:
+
+    )" APP_NAME R"( SUBCMD <OPTIONS>
+    )" APP_NAME R"( -h/--help
+    )" APP_NAME R"( SUBCMD -h/--help
+    )" APP_NAME R"( --completion-script bash|zsh|fish
+    )" APP_NAME R"( --profile text|json[:FILE] SUBCMD <OPTIONS>
+
+Options:
+
+)");
+	printOptions(g_globalOptions);
+
+	printf("Subcommands:\n\n");
+	for (const SubcommandEntry& e : g_subcommands)
+		printf("    %-12s%s\n", e.name, e.summary);
+
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
 	int result = 0;
 
+	ArgCompleter completer;
+	completer.addSubcommands(g_subcommandNames);
+	completer.addOptions(NULL, APP_GLOBAL_OPTIONS(APP_OPTION_NAMES));
+	completer.addOptions("compile", COMPILE_OPTIONS(APP_OPTION_NAMES));
+	completer.addOptions("script", SCRIPT_OPTIONS(APP_OPTION_NAMES));
+
+	if (ArgCompleter::isCompletionRequest(argc, argv))
+		return completer.printCompletions(argc - 2, argv + 2);
+
+	// the global options come before the subcommand
 	ArgParser parser;
+	parser.setScopeCommands(g_subcommandNames);
 	parser.parse(argc, argv);
 
-	bool hasHelp = parser.hasArg("h", "help");
+	const char* profileFormat = parser.getArg("profile");
+	if (profileFormat != NULL && !ArgProfiler::enable(profileFormat))
+	{
+		printf("error: Unknown profile format: %s\n", profileFormat);
+		return -1;
+	}
 
-	const char* commandName = parser.getSubcommand("compile,test");
+	const char* shellName = parser.getArg("completion-script");
+	if (shellName != NULL)
+	{
+		CompletionShell shell;
+		if (!ArgCompleter::parseShellName(shellName, &shell))
+		{
+			printf("error: Unknown shell: %s\n", shellName);
+			return -1;
+		}
+		char script[1024];
+		ArgCompleter::writeScript(shell, APP_NAME, script, sizeof(script));
+		fputs(script, stdout);
+		return 0;
+	}
+
+	const char* commandName = parser.getSubcommand(g_subcommandNames);
 	if (commandName == NULL)
 	{
-		if (hasHelp)
+		if (parser.hasArg("h", "help"))
 			return printHelp();
 		return -1;
 	}
 
-	Subcommand* cmd = NULL;
-	if (strcmp(commandName, "test") == 0)
-		cmd = new TestSubcommand;
-	else if (strcmp(commandName, "compile") == 0)
-		cmd = new CompileSubcommand;
+	// the options of the subcommand, it still sees the global ones
+	ArgParser commandParser;
+	commandParser.parseScope(&parser);
+
+	const SubcommandEntry* entry = g_subcommands.find(commandName);
+	Subcommand* cmd = entry != NULL ? entry->create() : NULL;
 
 	if (cmd != NULL)
 	{
-		if (hasHelp)
+		if (commandParser.hasArg("h", "help"))
 		{
 			cmd->printHelp();
 		}
-		else if (cmd->parseArguments(parser))
+		else if (parseArguments(cmd, commandParser))
 		{
-			if (!parser.hasUnknownArgs())
+			bool hasUnknownArgs = parser.printUnknownArgs();
+			hasUnknownArgs = commandParser.printUnknownArgs() || hasUnknownArgs;
+			if (!hasUnknownArgs)
+			{
+				ArgProfileScope profile("run");
 				result = cmd->run();
-			else
-				parser.printUnknownArgs();
+			}
 		}
 	}
 
@@ -0,0 +1,14 @@
+#include "../src/nc_subcommand_plugin.h"
+
+/*
+	A subcommand in a shared library, loaded by the unit tests through SubcommandPlugins.
+*/
+class PluginSubcommand : public Subcommand
+{
+public:
+	virtual void printHelp() override {}
+	virtual bool parseArguments(ArgParser&) override { return true; }
+	virtual int run() override { return 42; }
+};
+
+NC_SUBCOMMAND_PLUGIN(PluginSubcommand)